@@ -1,13 +1,52 @@
 /*
  * Trial by Combat - Raylib Edition
- * Compile: gcc trial_by_combat_raylib.c -lraylib -lm -o trial_by_combat
+ * Compile: gcc trial_by_combat_raylib.c -lraylib -lm -lpthread -ldl -o trial_by_combat
+ * Options: --render-scale F   internal resolution, 1.0 = 720 lines (max 3.0)
+ *          --dynres           lower the internal resolution when over budget
+ *          --play FILE        replay an input script instead of the keyboard
+ *          --record FILE      write this session's input as a script
+ *          --report FILE      per-frame timing CSV (+ summary on stdout)
+ *          --seed N           fixed RNG seed
+ *          --export DIR       with --play: render headless, write DIR/frame_NNNNNN.png
+ *          --engine LIB       take turn rules/AI from LIB, reloaded on change (see ENGINE)
+ *          --ai NAME          computer personality from tbc_ai.txt (see AI)
+ *          --coop-host PORT   networked co-op gauntlet: wait for a partner...
+ *          --coop-join H:PORT ...or join one; --coop-class NAME picks your
+ *                             champion (see CO-OP LINK)
+ *   Tools (no window):
+ *          --solve A,B        best play for class A vs the computer as B, distilled
+ *                             into a decision tree (--solve-turns, --tree-depth,
+ *                             --emit FILE.c, --threads N); see DUEL SOLVER
+ *          --retune           after --solve, read NAME=VALUE balance edits from
+ *                             stdin and re-solve only what they touch
+ *          --sensitivity N    win-rate slope per balance number and matchup, N
+ *                             CRN game pairs per cell (--csv FILE); see BALANCE SENSITIVITY
+ *          --lengths all|A,B  exact duel length and turn-limit odds (--len-floor F,
+ *                             --csv FILE); see MATCH LENGTH
+ *          --gauntlet CLASS   exact gauntlet clear odds, layers on disk
+ *                             (--gauntlet-turns N, --player-ai NAME, --tmp DIR,
+ *                             --mem MB); see GAUNTLET ENUMERATION
+ *          --balance-check F  replay the seeded balance suite and fail on drift
+ *                             from baseline F; --balance-save F writes one; see
+ *                             BALANCE REGRESSION
+ *          --sim-export DIR   AI-vs-AI games as column files for the dashboard
+ *                             (--sim-games N, default 200000); see DASHBOARD
+ *          --coop-test N      N co-op games between two loopback peers, fails
+ *                             if they ever fall out of lockstep
+ *   Benchmark: ./trial_by_combat --play bench/full_match.txt --report frames.csv
  *
  * Sprites (place PNGs in same folder as executable):
  *   p1_knight.png   p1_magician.png   p1_alchemist.png
  *   p2_knight.png   p2_magician.png   p2_alchemist.png
  * When a fighter's HP hits 0, their sprite vanishes completely.
  *
- * Window: 1280x720, black background
+ * Files written next to the executable:
+ *   tbc_save.bin      checkpoint of the match in progress (resumed on launch)
+ *   tbc_metrics.prom  turn latency / match counters, Prometheus text format
+ * Read if present: tbc_ai.txt (extra computer personalities), tbc_sim/ (column
+ * files from --sim-export, shown on the hidden DASHBOARD screen)
+ *
+ * Window: 1280x720 (resizable, layout follows the aspect ratio), black background
  * Layout:
  *   TOP:    P1 name + HP bar + charge pips (left)
  *           P2 name + HP bar + charge pips (right)
@@ -15,11 +54,34 @@
  *   BOTTOM: move menu / battle log / result screen
  */
 
+#define _POSIX_C_SOURCE 200809L   /* clock_gettime */
+
 #include "raylib.h"
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <time.h>
+#include <stdint.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <signal.h>
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#else
+#include <direct.h>
+#endif
 
 /* ===================== CONSTANTS ===================== */
 
@@ -29,6 +91,7 @@
 #define MAX_CHARGE     10
 #define MAX_TURNS      25
 #define MAX_DOT_STACKS 3
+#define MAX_SUNDER     30   /* total DEF a fighter can lose; position keys hold it in 4 bits of 2s */
 #define MAX_LOG_LINES  8
 
 #define MOVE_ATK  0
@@ -37,12 +100,72 @@
 #define MOVE_BUFF 3
 #define MOVE_ULT  4
 
-static const int CHARGE_GAIN[5] = {3, 2, 1, 1, 0};
-
 #define CLASS_KNIGHT    0
 #define CLASS_MAGICIAN  1
 #define CLASS_ALCHEMIST 2
 
+/*
+ * Balance numbers. Game logic reads them through BAL(), which also notes the
+ * read in a per-thread mask so the solver knows which parameters a position's
+ * value depends on (and can re-solve only those after a tweak).
+ */
+enum {
+    BAL_KNIGHT_HP,    BAL_KNIGHT_ATK,    BAL_KNIGHT_DEF,    BAL_KNIGHT_SPD,    BAL_KNIGHT_CRT,    BAL_KNIGHT_BUFF,
+    BAL_MAGICIAN_HP,  BAL_MAGICIAN_ATK,  BAL_MAGICIAN_DEF,  BAL_MAGICIAN_SPD,  BAL_MAGICIAN_CRT,  BAL_MAGICIAN_BUFF,
+    BAL_ALCHEMIST_HP, BAL_ALCHEMIST_ATK, BAL_ALCHEMIST_DEF, BAL_ALCHEMIST_SPD, BAL_ALCHEMIST_CRT, BAL_ALCHEMIST_BUFF,
+    BAL_ATK_KNIGHT, BAL_ATK_MAGICIAN, BAL_ATK_ALCHEMIST,
+    BAL_ULT_KNIGHT, BAL_ULT_MAGICIAN, BAL_ULT_ALCHEMIST,
+    BAL_DOT_1, BAL_DOT_2, BAL_DOT_3,
+    BAL_GAIN_ATK, BAL_GAIN_DEF, BAL_GAIN_DOT, BAL_GAIN_BUFF, BAL_GAIN_ULT,
+    BAL_DODGE,
+    BAL_COUNT
+};
+
+#define BAL_CLASS_STATS 6   /* HP ATK DEF SPD CRT BUFF per class, read by initFighter */
+#define BAL_STAT_MASK   ((1ull << (3*BAL_CLASS_STATS)) - 1)
+
+typedef struct { int v[BAL_COUNT]; } Balance;
+
+static const Balance BALANCE_DEFAULT = {{
+    115, 10, 12,  9, 12, 4,   /* knight */
+    105, 10, 10, 12, 12, 4,   /* magician */
+    110, 12, 10, 10, 12, 4,   /* alchemist */
+    15, 13, 14,       /* basic attack damage per class */
+    28, 26, 22,       /* ult damage per class */
+    5, 8, 12,         /* DoT tick at 1/2/3 stacks */
+    3, 2, 1, 1, 0,    /* charge gained per move type */
+    5,                /* dodge % before SPD */
+}};
+
+static const char *BAL_NAME[BAL_COUNT] = {
+    "KNIGHT_HP", "KNIGHT_ATK", "KNIGHT_DEF", "KNIGHT_SPD", "KNIGHT_CRT", "KNIGHT_BUFF",
+    "MAGICIAN_HP", "MAGICIAN_ATK", "MAGICIAN_DEF", "MAGICIAN_SPD", "MAGICIAN_CRT", "MAGICIAN_BUFF",
+    "ALCHEMIST_HP", "ALCHEMIST_ATK", "ALCHEMIST_DEF", "ALCHEMIST_SPD", "ALCHEMIST_CRT", "ALCHEMIST_BUFF",
+    "BASE_ATK_DAMAGE[0]", "BASE_ATK_DAMAGE[1]", "BASE_ATK_DAMAGE[2]",
+    "BASE_ULT_DAMAGE[0]", "BASE_ULT_DAMAGE[1]", "BASE_ULT_DAMAGE[2]",
+    "DOT_BASE[0]", "DOT_BASE[1]", "DOT_BASE[2]",
+    "CHARGE_GAIN[0]", "CHARGE_GAIN[1]", "CHARGE_GAIN[2]", "CHARGE_GAIN[3]", "CHARGE_GAIN[4]",
+    "DODGE_BASE",
+};
+
+/* Per thread, so sweeps can run variants side by side */
+static _Thread_local const Balance *gBal = &BALANCE_DEFAULT;
+static _Thread_local uint64_t gBalReads;
+
+#define BAL(id) (gBalReads |= 1ull << (id), gBal->v[id])
+
+/* Why v can't be parameter id, or NULL if it can. Positions pack HP in 8
+ * bits and charge in 4, so those are held to what fits. Sunder is capped at
+ * MAX_SUNDER where it lands, so however often a gain lets the knight ult
+ * the penalty still fits its 4 bits. */
+const char *balRange(int id, int v) {
+    if (id < 3*BAL_CLASS_STATS && id % BAL_CLASS_STATS == 0)
+        return v < 1 || v > 255 ? "HP must be 1..255 to fit the position key" : NULL;
+    if (id >= BAL_GAIN_ATK && id <= BAL_GAIN_ULT)
+        return v < 0 || v > MAX_CHARGE ? "charge gain must be 0..10" : NULL;
+    return v < 0 || v > 999 ? "must be 0..999" : NULL;
+}
+
 /* Sprite placeholder colors per class (used on class select screen only) */
 static const Color CLASS_COLOR[3] = {
     {120, 140, 200, 255},  /* Knight   - steel blue */
@@ -78,38 +201,49 @@ typedef struct {
 } Fighter;
 
 typedef struct {
-    char name[32];
-    int  type;
-    int  cost;
+    char           name[32];
+    int            type;
+    int            cost;
+    const uint8_t *fx;     /* effect bytecode (ults), see MOVE EFFECTS */
 } Move;
 
 /* ===================== MOVE TABLES ===================== */
 
+/* Effect programs: opcode, then its operand bytes */
+enum {
+    FX_END,      /*                                   */
+    FX_HIT,      /* BAL_ULT_* defDiv critNum critDen  */
+    FX_SUNDER,   /* amount: permanent DEF penalty     */
+    FX_SPLIT,    /* pct: pool both HPs, attacker gets pct */
+    FX_OP_COUNT
+};
+
+static const uint8_t FX_KNIGHT_ULT[]    = { FX_HIT, BAL_ULT_KNIGHT, 1, 7, 5, FX_SUNDER, 2, FX_END };
+static const uint8_t FX_MAGICIAN_ULT[]  = { FX_HIT, BAL_ULT_MAGICIAN, 2, 7, 5, FX_END };
+static const uint8_t FX_ALCHEMIST_ULT[] = { FX_HIT, BAL_ULT_ALCHEMIST, 1, 7, 5, FX_SPLIT, 60, FX_END };
+
 static Move KNIGHT_MOVES[5] = {
-    {"Steady Blade",          MOVE_ATK,  0},
-    {"Aegis Wall",            MOVE_DEF,  0},
-    {"Mortal Wounds",         MOVE_DOT,  3},
-    {"Indomitable Spirit",    MOVE_BUFF, 2},
-    {"Executioner's Verdict", MOVE_ULT,  10}
+    {"Steady Blade",          MOVE_ATK,  0,  NULL},
+    {"Aegis Wall",            MOVE_DEF,  0,  NULL},
+    {"Mortal Wounds",         MOVE_DOT,  3,  NULL},
+    {"Indomitable Spirit",    MOVE_BUFF, 2,  NULL},
+    {"Executioner's Verdict", MOVE_ULT,  10, FX_KNIGHT_ULT}
 };
 static Move MAGICIAN_MOVES[5] = {
-    {"Elemental Spark",  MOVE_ATK,  0},
-    {"Mana Barrier",     MOVE_DEF,  0},
-    {"Flesh Embers",     MOVE_DOT,  3},
-    {"Runic Overclock",  MOVE_BUFF, 2},
-    {"Arcane Overload",  MOVE_ULT,  10}
+    {"Elemental Spark",  MOVE_ATK,  0,  NULL},
+    {"Mana Barrier",     MOVE_DEF,  0,  NULL},
+    {"Flesh Embers",     MOVE_DOT,  3,  NULL},
+    {"Runic Overclock",  MOVE_BUFF, 2,  NULL},
+    {"Arcane Overload",  MOVE_ULT,  10, FX_MAGICIAN_ULT}
 };
 static Move ALCHEMIST_MOVES[5] = {
-    {"Primed Flask",        MOVE_ATK,  0},
-    {"Pact of Attrition",   MOVE_DEF,  0},
-    {"Vial of Corrosion",   MOVE_DOT,  3},
-    {"Adrenal Mixture",     MOVE_BUFF, 2},
-    {"Grand Transmutation", MOVE_ULT,  10}
+    {"Primed Flask",        MOVE_ATK,  0,  NULL},
+    {"Pact of Attrition",   MOVE_DEF,  0,  NULL},
+    {"Vial of Corrosion",   MOVE_DOT,  3,  NULL},
+    {"Adrenal Mixture",     MOVE_BUFF, 2,  NULL},
+    {"Grand Transmutation", MOVE_ULT,  10, FX_ALCHEMIST_ULT}
 };
 
-static const int BASE_ATK_DAMAGE[3] = {15, 13, 14};
-static const int BASE_ULT_DAMAGE[3] = {28, 26, 22};
-static const int DOT_BASE[3]        = {5,  8,  12};
 
 /* ===================== GAME STATE ===================== */
 
@@ -123,6 +257,7 @@ typedef enum {
     SCREEN_RESULT,
     SCREEN_GAUNTLET_BATTLE,   /* secret 3v1 mode - choosing move + target */
     SCREEN_GAUNTLET_RESOLVE,  /* secret 3v1 mode - showing results        */
+    SCREEN_DASHBOARD,         /* secret balance dashboard                 */
 } GameScreen;
 
 typedef struct {
@@ -141,6 +276,7 @@ typedef struct {
     int        selectedMove;      /* cursor in move menu */
     char       resultMsg[128];
     int        postChoice;        /* 0=none,1=again,2=menu,3=exit */
+    int        hoverClass;        /* cursor on class/opponent select */
 
     /* === GAUNTLET STATE === */
     int        gauntletMode;      /* 1 if in gauntlet */
@@ -148,9 +284,30 @@ typedef struct {
     int        selectedTarget;    /* 0/1/2 which enemy to attack */
     int        gauntletMove;      /* player's chosen move this turn */
 
+    /* === ENDLESS (secret gauntlet variant) === */
+    int        endless;           /* 1: dead slots are refilled from waves */
+    int        wave;              /* current wave, from 1 */
+    int        waveLeft;          /* enemies of this wave not yet spawned */
+    int        spawned;           /* enemies spawned this run, for kills */
+
+    /* === CO-OP (secret gauntlet variant, p2 is the second champion) === */
+    int        coop;              /* 0 off, 1 split keyboard, 2 networked */
+    int        seat;              /* networked: our champion, 0 = p1, 1 = p2 */
+    int        selectedMove2, selectedTarget2, gauntletMove2;
+    int        locked;            /* bit per champion locked in this turn */
+    uint32_t   netHash;           /* coopHash when we locked in, sent along */
+    int        peerTurn, peerMove, peerTarget;   /* partner's latest command, -1: gone */
+    uint32_t   peerHash;
+
+    /* Balance version this match plays on (see BALANCE PATCHES). Owned by
+     * the thread running updateGame; render snapshots carry a stale copy. */
+    struct BalVersion *bal;
+
     /* secret word buffer for menu unlock */
     char       secretBuf[16];
     int        secretLen;
+
+    unsigned   version;           /* changes whenever HUD-visible state does */
 } GameState;
 
 /* ===================== HELPERS ===================== */
@@ -159,7 +316,68 @@ int eAtk(Fighter *f) { return f->baseAtk + (f->buffActive && f->buffStat==2 ? f-
 int eDef(Fighter *f) { int d = f->baseDef + (f->buffActive && f->buffStat==0 ? f->buffAmt:0) - f->defPenalty; return d<0?0:d; }
 int eSpd(Fighter *f) { return f->baseSpd  + (f->buffActive && f->buffStat==1 ? f->buffAmt : 0); }
 
-int randPct(void) { return rand() % 100; }
+/* Endless mode: every enemy spawned this run that isn't still standing */
+int endlessKills(const GameState *gs) {
+    int alive = 0;
+    for (int i=0;i<3;i++) alive += gs->enemies[i].hp > 0;
+    return gs->spawned - alive;
+}
+
+/* xorshift32: the whole generator is one word, so it checkpoints with the
+ * match. One per thread: the sim thread is handed the seed in simStart. */
+static _Thread_local uint32_t gRng = 2463534242u;
+
+void     seedRng(uint32_t seed) { gRng = seed ? seed : 2463534242u; }
+static inline uint32_t rngStep(uint32_t x) { x^=x<<13; x^=x>>17; x^=x<<5; return x; }
+uint32_t nextRng(void) { return gRng = rngStep(gRng); }
+int      randPct(void) { return (int)(nextRng() % 100); }
+
+/*
+ * Chance points: turn resolution asks rollPct(p) for every random outcome.
+ * Normally that is a draw; with a ChanceTrace installed (the solver) each call
+ * follows or extends a scripted path instead, and chanceNext() steps to the
+ * next path, so one resolveTurn per path visits every outcome exactly once.
+ * AI move picks are chance points too (one yes/no per move, see AI).
+ */
+#define CHANCE_MAX_POINTS 32
+
+typedef struct {
+    uint8_t hit[CHANCE_MAX_POINTS];
+    double  odds[CHANCE_MAX_POINTS][2];   /* chance of no, yes */
+    int     len, pos;
+} ChanceTrace;
+
+static _Thread_local ChanceTrace *gChance;
+
+/* The next yes/no point on the installed trace */
+static int chancePoint(double no, double yes) {
+    ChanceTrace *t = gChance;
+    if (t->pos == t->len) { t->hit[t->len] = 1; t->odds[t->len][0] = no; t->odds[t->len][1] = yes; t->len++; }
+    return t->hit[t->pos++];
+}
+
+int rollPct(int pct) {
+    if (!gChance) return randPct() < pct;
+    if (pct <= 0)   return 0;
+    if (pct >= 100) return 1;
+    return chancePoint((100 - pct) / 100.0, pct / 100.0);
+}
+
+/* Probability of the path just taken */
+double chanceProb(const ChanceTrace *t) {
+    double p = 1.0;
+    for (int i=0;i<t->len;i++) p *= t->odds[i][t->hit[i]];
+    return p;
+}
+
+/* Backtracks to the next unvisited path; 0 when all are done */
+int chanceNext(ChanceTrace *t) {
+    while (t->len && !t->hit[t->len-1]) t->len--;
+    if (!t->len) return 0;
+    t->hit[t->len-1] = 0;
+    t->pos = 0;
+    return 1;
+}
 
 int calcDamage(int base, int atk, int def) {
     int d = base + (atk/2) - (def/3);
@@ -180,18 +398,10 @@ void initFighter(Fighter *f, const char *name, int classId) {
     memset(f, 0, sizeof(*f));
     strncpy(f->name, name, 31);
     f->classId = classId;
-    f->crt = 12;
-    switch (classId) {
-        case CLASS_KNIGHT:
-            f->hp=f->maxHp=115; f->baseAtk=10; f->baseDef=12; f->baseSpd=9;
-            f->buffStat=0; f->buffAmt=4; break;
-        case CLASS_MAGICIAN:
-            f->hp=f->maxHp=105; f->baseAtk=10; f->baseDef=10; f->baseSpd=12;
-            f->buffStat=1; f->buffAmt=4; break;
-        case CLASS_ALCHEMIST:
-            f->hp=f->maxHp=110; f->baseAtk=12; f->baseDef=10; f->baseSpd=10;
-            f->buffStat=2; f->buffAmt=4; break;
-    }
+    int s = classId * BAL_CLASS_STATS;
+    f->hp=f->maxHp=BAL(s+0); f->baseAtk=BAL(s+1); f->baseDef=BAL(s+2); f->baseSpd=BAL(s+3);
+    f->crt=BAL(s+4); f->buffAmt=BAL(s+5);
+    f->buffStat = classId;   /* knight DEF, magician SPD, alchemist ATK */
 }
 
 void logAdd(BattleLog *log, const char *msg) {
@@ -205,28 +415,506 @@ void logAdd(BattleLog *log, const char *msg) {
     }
 }
 
+/* Formats a log line; skipped entirely when log is NULL (solver, batch runs) */
+#define LOGF(log, ...) do { if (log) { char lb_[128]; snprintf(lb_, sizeof(lb_), __VA_ARGS__); logAdd((log), lb_); } } while (0)
+
 void logClear(BattleLog *log) { log->count = 0; }
 
+/* Stamp gs with a fresh version. A global serial, so a memset state can never
+ * come back with a version some cache already holds. Atomic: --coop-test
+ * runs two games' updates at once. */
+void stateChanged(GameState *gs) {
+    static atomic_uint serial;
+    gs->version = atomic_fetch_add_explicit(&serial, 1u, memory_order_relaxed) + 1u;
+}
+
+/* ===================== METRICS ===================== */
+/*
+ * Operational counters for kiosk/server hosts. Recording on the turn path is
+ * one clock read plus a few relaxed atomic adds. metricsDump() writes the set
+ * in Prometheus text format to METRICS_FILE (temp file + rename, so scrapers
+ * never see half a file); point a node_exporter textfile collector at it.
+ *
+ * Latency uses a log-linear (HDR style) histogram: 8 linear sub-buckets per
+ * power of two of nanoseconds, i.e. ~12% worst-case quantile error.
+ */
+#define METRICS_FILE      "tbc_metrics.prom"
+#define METRICS_DUMP_SECS 10.0
+#define HIST_SUB_BITS     3
+#define HIST_SUB          (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS      (42 * HIST_SUB)
+
+typedef struct {
+    atomic_ullong matchesStarted;
+    atomic_ullong matchesFinished;
+    atomic_ullong turnsResolved;
+    atomic_ullong turnNsSum;
+    atomic_uint   queueDepth;     /* input frames waiting for the sim thread */
+    atomic_uint   turnNs[HIST_BUCKETS];
+} Metrics;
+
+static Metrics gMetrics;
+
+uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int histBucket(uint64_t v) {
+    if (v < HIST_SUB) return (int)v;
+    int msb = 0;
+    while ((v >> msb) > 1) msb++;
+    int shift = msb - HIST_SUB_BITS;
+    int b = ((shift+1) << HIST_SUB_BITS) + (int)((v >> shift) & (HIST_SUB-1));
+    return b < HIST_BUCKETS ? b : HIST_BUCKETS-1;
+}
+
+/* Upper edge of bucket b, used when reporting quantiles */
+uint64_t histBucketTop(int b) {
+    if (b < HIST_SUB) return (uint64_t)b;
+    int shift = (b >> HIST_SUB_BITS) - 1;
+    return ((uint64_t)(HIST_SUB + (b & (HIST_SUB-1)) + 1) << shift) - 1;
+}
+
+void metricsAdd(atomic_ullong *c) { atomic_fetch_add_explicit(c, 1, memory_order_relaxed); }
+
+void metricsTurn(uint64_t ns) {
+    metricsAdd(&gMetrics.turnsResolved);
+    atomic_fetch_add_explicit(&gMetrics.turnNsSum, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&gMetrics.turnNs[histBucket(ns)], 1, memory_order_relaxed);
+}
+
+/* Snapshot the histogram and write everything out. Rates are computed
+ * against the previous dump, so call this on a steady period. */
+void metricsDump(size_t matchBytes) {
+    static double   lastT;
+    static uint64_t lastFinished;
+    static unsigned snap[HIST_BUCKETS];
+
+    uint64_t total = 0;
+    for (int i=0;i<HIST_BUCKETS;i++) {
+        snap[i] = atomic_load_explicit(&gMetrics.turnNs[i], memory_order_relaxed);
+        total += snap[i];
+    }
+    uint64_t started  = atomic_load_explicit(&gMetrics.matchesStarted,  memory_order_relaxed);
+    uint64_t finished = atomic_load_explicit(&gMetrics.matchesFinished, memory_order_relaxed);
+    uint64_t turns    = atomic_load_explicit(&gMetrics.turnsResolved,   memory_order_relaxed);
+    uint64_t nsSum    = atomic_load_explicit(&gMetrics.turnNsSum,       memory_order_relaxed);
+
+    double t  = nowNs() * 1e-9;
+    double dt = (lastT > 0) ? t - lastT : 0;
+    double mps = (dt > 0) ? (double)(finished - lastFinished) / dt : 0;
+    lastT = t; lastFinished = finished;
+
+    FILE *f = fopen(METRICS_FILE ".tmp", "w");
+    if (!f) return;
+    fprintf(f, "# TYPE tbc_matches_started_total counter\ntbc_matches_started_total %llu\n", (unsigned long long)started);
+    fprintf(f, "# TYPE tbc_matches_finished_total counter\ntbc_matches_finished_total %llu\n", (unsigned long long)finished);
+    fprintf(f, "# TYPE tbc_matches_per_second gauge\ntbc_matches_per_second %.4f\n", mps);
+    fprintf(f, "# TYPE tbc_match_state_bytes gauge\ntbc_match_state_bytes %zu\n", matchBytes);
+    fprintf(f, "# TYPE tbc_input_queue_depth gauge\ntbc_input_queue_depth %u\n",
+            atomic_load_explicit(&gMetrics.queueDepth, memory_order_relaxed));
+    fprintf(f, "# TYPE tbc_turn_latency_seconds summary\n");
+    static const double q[4] = {0.5, 0.9, 0.99, 0.999};
+    for (int k=0;k<4;k++) {
+        uint64_t want = (uint64_t)(q[k]*total + 0.5), seen = 0;
+        int b = 0;
+        if (want == 0) want = 1;
+        while (b < HIST_BUCKETS-1 && (seen += snap[b]) < want) b++;
+        fprintf(f, "tbc_turn_latency_seconds{quantile=\"%g\"} %.9f\n", q[k], total ? histBucketTop(b)*1e-9 : 0.0);
+    }
+    fprintf(f, "tbc_turn_latency_seconds_sum %.9f\n", nsSum*1e-9);
+    fprintf(f, "tbc_turn_latency_seconds_count %llu\n", (unsigned long long)turns);
+    fclose(f);
+    rename(METRICS_FILE ".tmp", METRICS_FILE);
+}
+
 /* ===================== AI ===================== */
+/*
+ * Computer opponents are policies written in a small rule language and
+ * compiled at load time into a flat table: every (hp bucket, charge, buffed,
+ * opponent buffed, opponent DoT stacks) cell holds the cumulative odds of the
+ * five moves, so a decision is one table read and one RNG draw.
+ *
+ *   policy NAME
+ *   MOVE PCT [if COND {and COND}]      rule: rolls PCT% to pick MOVE
+ *   or MOVE PCT [if COND {and COND}]   shares the roll of the rule above
+ *   default MOVE                       when nothing fires (ATK if omitted, or
+ *                                      if MOVE can't be paid for)
+ *
+ * MOVE is atk/def/dot/buff/ult. COND is "VAR OP N" (OP: < <= > >= == !=) over
+ * hp (own HP %), charge, dot (opponent DoT stacks), or a bare [not] buff /
+ * oppbuff. A rule whose move can't be paid for doesn't fire. Policies from
+ * AI_FILE are added to the built-in "default"; a bad line drops the policy
+ * it is in (with a message) and loading goes on with the next one.
+ */
+#define AI_FILE           "tbc_ai.txt"
+#define AI_MAX_POLICIES   8
+#define AI_MAX_RULES      32
+#define AI_MAX_CONDS      4
+#define AI_MAX_HP_BUCKETS 16
+#define AI_ODDS_ONE       32768   /* odds are in 1/32768 */
+
+static const char *AI_BUILTIN =
+    "policy default\n"
+    "ult 65 if charge == 10\n"
+    "def 60 if hp < 25\n"
+    "atk 45 if oppbuff\n"
+    "or dot 25 if oppbuff and charge >= 3\n"
+    "dot 35 if dot < 3 and charge >= 3\n"
+    "buff 40 if not buff and charge >= 2 and hp > 40\n"
+    "def 25 if charge >= 7 and charge < 10\n"
+    "default atk\n";
+
+enum { AV_HP, AV_CHARGE, AV_DOT, AV_BUFF, AV_OPPBUFF };
+enum { AO_LT, AO_LE, AO_GT, AO_GE, AO_EQ, AO_NE };
+
+typedef struct { uint8_t var, op; int16_t k; } AiCond;
+typedef struct { uint8_t move, pct, group, condCount; AiCond cond[AI_MAX_CONDS]; } AiRule;
+
+typedef struct {
+    char     name[24];
+    uint8_t  hpBucket[101];
+    /* cumulative odds of ATK, DEF, DOT, BUFF; ULT takes the rest */
+    uint16_t odds[AI_MAX_HP_BUCKETS][MAX_CHARGE+1][2][2][MAX_DOT_STACKS+1][4];
+} AiPolicy;
+
+static AiPolicy  gAiPolicies[AI_MAX_POLICIES];
+static int       gAiPolicyCount;
+static const AiPolicy *gAi;   /* policy the computer plays */
+
+static int aiCondHolds(const AiCond *c, const int *vars) {
+    int v = vars[c->var];
+    switch (c->op) {
+        case AO_LT: return v <  c->k;
+        case AO_LE: return v <= c->k;
+        case AO_GT: return v >  c->k;
+        case AO_GE: return v >= c->k;
+        case AO_EQ: return v == c->k;
+        default:    return v != c->k;
+    }
+}
+
+/* Fills p's table from the rules: the odds are exact, not sampled */
+static void aiCompile(AiPolicy *p, const AiRule *rules, int ruleCount, int fallback) {
+    /* hp buckets split at every hp value a rule compares against */
+    int cut[102] = {0};
+    for (int i=0;i<ruleCount;i++)
+        for (int j=0;j<rules[i].condCount;j++) {
+            const AiCond *c = &rules[i].cond[j];
+            if (c->var != AV_HP) continue;
+            int k = c->k;
+            if (c->op==AO_LE || c->op==AO_GT || c->op==AO_EQ || c->op==AO_NE) k++;
+            if (k>0 && k<=100) cut[k] = 1;
+            if ((c->op==AO_EQ || c->op==AO_NE) && c->k>0 && c->k<=100) cut[c->k] = 1;
+        }
+    int bucketLow[AI_MAX_HP_BUCKETS] = {0}, buckets = 1;
+    for (int h=0;h<=100;h++) {
+        if (h>0 && cut[h]) {
+            if (buckets < AI_MAX_HP_BUCKETS) bucketLow[buckets++] = h;
+            else fprintf(stderr, "AI policy %s: too many hp thresholds, hp %d merged\n", p->name, h);
+        }
+        p->hpBucket[h] = (uint8_t)(buckets-1);
+    }
+
+    Move *costs = getMoves(CLASS_KNIGHT);   /* move costs are the same for every class */
+    for (int hb=0;hb<buckets;hb++)
+    for (int ch=0;ch<=MAX_CHARGE;ch++)
+    for (int bf=0;bf<2;bf++)
+    for (int ob=0;ob<2;ob++)
+    for (int dt=0;dt<=MAX_DOT_STACKS;dt++) {
+        int vars[5] = { bucketLow[hb], ch, dt, bf, ob };
+        double prob[5] = {0}, reach = 1.0;
+        for (int i=0;i<ruleCount;) {
+            int g = rules[i].group;
+            double taken = 0;
+            for (; i<ruleCount && rules[i].group==g; i++) {
+                const AiRule *r = &rules[i];
+                int ok = (costs[r->move].cost <= ch);
+                for (int j=0;j<r->condCount && ok;j++) ok = aiCondHolds(&r->cond[j], vars);
+                if (ok) { prob[r->move] += reach*r->pct/100.0; taken += r->pct/100.0; }
+            }
+            reach *= (taken < 1.0 ? 1.0 - taken : 0.0);
+        }
+        prob[costs[fallback].cost <= ch ? fallback : MOVE_ATK] += reach;   /* ATK is free */
+        double cum = 0;
+        for (int m=0;m<4;m++) {
+            cum += prob[m];
+            p->odds[hb][ch][bf][ob][dt][m] = (uint16_t)(cum*AI_ODDS_ONE + 0.5);
+        }
+    }
+}
+
+static int aiParseWord(const char *w, const char *const *names, int n) {
+    for (int i=0;i<n;i++) if (!strcmp(w, names[i])) return i;
+    return -1;
+}
+
+/* Compiles every policy in src; returns how many were added */
+int aiLoadPolicies(const char *src, const char *origin) {
+    static const char *MOVE_WORD[5] = {"atk","def","dot","buff","ult"};
+    static const char *VAR_WORD[5]  = {"hp","charge","dot","buff","oppbuff"};
+    static const char *OP_WORD[6]   = {"<","<=",">",">=","==","!="};
+    AiRule rules[AI_MAX_RULES];
+    int ruleCount = 0, group = 0, fallback = MOVE_ATK, added = 0, lineNo = 0, skipping = 0;
+    AiPolicy *cur = NULL;
+
+    const char *p = src;
+    while (*p) {
+        char line[256];
+        size_t n = strcspn(p, "\n"), len = n < sizeof(line)-1 ? n : sizeof(line)-1;
+        memcpy(line, p, len); line[len] = '\0';
+        p += n + (p[n] == '\n');
+        lineNo++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char *tok[24]; int nt = 0;
+        for (char *t = strtok(line, " \t\r"); t && nt < 24; t = strtok(NULL, " \t\r")) tok[nt++] = t;
+
+        if (!nt) continue;
+        if (!strcmp(tok[0], "policy")) {
+            if (cur) { aiCompile(cur, rules, ruleCount, fallback); added++; }
+            cur = NULL;
+            if (nt != 2 || gAiPolicyCount == AI_MAX_POLICIES) goto bad;
+            cur = &gAiPolicies[gAiPolicyCount++];
+            snprintf(cur->name, sizeof(cur->name), "%s", tok[1]);
+            ruleCount = group = 0; fallback = MOVE_ATK; skipping = 0;
+            continue;
+        }
+        if (!cur) { if (skipping) continue; goto bad; }
+
+        int t = 0;
+        if (!strcmp(tok[0], "default")) {
+            if (nt != 2 || (fallback = aiParseWord(tok[1], MOVE_WORD, 5)) < 0) goto bad;
+            continue;
+        }
+        AiRule *r = &rules[ruleCount];
+        memset(r, 0, sizeof(*r));
+        if (!strcmp(tok[0], "or")) { if (!ruleCount) goto bad; t++; }
+        else group++;
+        if (ruleCount == AI_MAX_RULES || t+2 > nt) goto bad;
+        int mv = aiParseWord(tok[t++], MOVE_WORD, 5);
+        int pct = atoi(tok[t++]);
+        if (mv < 0 || pct < 0 || pct > 100) goto bad;
+        r->move = (uint8_t)mv; r->pct = (uint8_t)pct; r->group = (uint8_t)group;
+
+        if (t < nt) {
+            if (strcmp(tok[t++], "if")) goto bad;
+            for (;;) {
+                if (t >= nt || r->condCount == AI_MAX_CONDS) goto bad;
+                AiCond *c = &r->cond[r->condCount++];
+                int neg = !strcmp(tok[t], "not");
+                t += neg;
+                if (t >= nt) goto bad;
+                int var = aiParseWord(tok[t++], VAR_WORD, 5);
+                if (var < 0) goto bad;
+                c->var = (uint8_t)var;
+                if (var == AV_BUFF || var == AV_OPPBUFF) {
+                    c->op = neg ? AO_EQ : AO_NE; c->k = 0;
+                } else {
+                    if (neg || t+2 > nt) goto bad;
+                    int op = aiParseWord(tok[t++], OP_WORD, 6);
+                    if (op < 0) goto bad;
+                    c->op = (uint8_t)op; c->k = (int16_t)atoi(tok[t++]);
+                }
+                if (t == nt) break;
+                if (strcmp(tok[t++], "and")) goto bad;
+            }
+        }
+        ruleCount++;
+        continue;
+    bad:   /* drop the policy the line is in, carry on at the next one */
+        if (cur) fprintf(stderr, "%s:%d: bad AI rule - policy %s skipped\n", origin, lineNo, cur->name);
+        else     fprintf(stderr, "%s:%d: bad AI rule or policy line - skipped up to the next policy\n", origin, lineNo);
+        if (cur) gAiPolicyCount--;
+        cur = NULL;
+        skipping = 1;
+    }
+    if (cur) { aiCompile(cur, rules, ruleCount, fallback); added++; }
+    return added;
+}
+
+/* Missing file is fine: the built-in policy is always there */
+int aiLoadFile(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *src = malloc((size_t)n + 1);
+    size_t got = fread(src, 1, (size_t)n, f);
+    src[got] = '\0';
+    fclose(f);
+    int added = aiLoadPolicies(src, path);
+    free(src);
+    return added;
+}
+
+const AiPolicy *aiFindPolicy(const char *name) {
+    for (int i=0;i<gAiPolicyCount;i++) if (!strcmp(gAiPolicies[i].name, name)) return &gAiPolicies[i];
+    return NULL;
+}
+
+/* Row of odds[][][][][] for one decision, flattened; hpPct 0..100 */
+static inline int aiCellIndex(const AiPolicy *p, int hpPct, int charge, int buff, int oppBuff, int dot) {
+    return (((p->hpBucket[hpPct] * (MAX_CHARGE+1) + charge) * 2 + buff) * 2 + oppBuff) * (MAX_DOT_STACKS+1) + dot;
+}
+
+static const uint16_t *aiCell(const AiPolicy *p, const Fighter *ai, const Fighter *opp) {
+    int hpPct = (ai->hp * 100) / ai->maxHp;
+    if (hpPct < 0) hpPct = 0; else if (hpPct > 100) hpPct = 100;
+    int dot = opp->dotStacks > MAX_DOT_STACKS ? MAX_DOT_STACKS : opp->dotStacks;
+    return p->odds[0][0][0][0][aiCellIndex(p, hpPct, ai->charge, ai->buffActive!=0, opp->buffActive!=0, dot)];
+}
+
+int aiPolicyChoose(const AiPolicy *p, const Fighter *ai, const Fighter *opp) {
+    const uint16_t *o = aiCell(p, ai, opp);
+    if (gChance) {   /* traced: "this move?" for each move with odds, in order */
+        int left = AI_ODDS_ONE, prev = 0;
+        for (int m=0;m<4;m++) {
+            int w = o[m] - prev;
+            prev = o[m];
+            if (w > 0 && (w == left || chancePoint((double)(left-w) / left, (double)w / left))) return m;
+            left -= w;
+        }
+        return 4;
+    }
+    uint32_t r = nextRng() >> 17;   /* 0..32767 */
+    return (r >= o[0]) + (r >= o[1]) + (r >= o[2]) + (r >= o[3]);
+}
+
+/* The whole move distribution in one position (for the solver) */
+void aiPolicyOdds(const AiPolicy *p, const Fighter *ai, const Fighter *opp, double prob[5]) {
+    const uint16_t *o = aiCell(p, ai, opp);
+    int prev = 0;
+    for (int m=0;m<4;m++) { prob[m] = (o[m]-prev) / (double)AI_ODDS_ONE; prev = o[m]; }
+    prob[4] = (AI_ODDS_ONE-prev) / (double)AI_ODDS_ONE;
+}
+
+const AiPolicy *aiActive(void) {
+    if (!gAi) {   /* first use in this image (game, engine library or tool) */
+        if (!gAiPolicyCount) aiLoadPolicies(AI_BUILTIN, "builtin");
+        gAi = &gAiPolicies[0];
+    }
+    return gAi;
+}
 
 int chooseMoveAI(Fighter *ai, Fighter *opp) {
+    return aiPolicyChoose(aiActive(), ai, opp);
+}
+
+/*
+ * Batched decisions, for runners that step many matches in lockstep: each
+ * tick gathers every pending decision's features into columns, maps them to
+ * table cells in one branch-free pass, draws, then reads the odds. Draws come
+ * from each decision's own stream (rng[stream]) in slot order, so a match
+ * gets exactly the moves chooseMoveAI would have given it. Not traced: runners
+ * using this never set gChance.
+ *
+ * This is scaffolding, not a speed-up yet: a 2M-game --sim-export takes the
+ * same 3-3.5 s with aiBatchRun or with aiPolicyChoose per decision, because
+ * resolveTurn is most of a tick. The columns are there for a SIMD or GPU
+ * policy pass to slot into.
+ */
+#define AI_BATCH 256
+
+typedef struct {
+    int      n;
+    uint8_t  hp[AI_BATCH], charge[AI_BATCH], buff[AI_BATCH], oppBuff[AI_BATCH], dot[AI_BATCH];
+    uint16_t stream[AI_BATCH];
+    uint16_t cell[AI_BATCH];
+    uint32_t draw[AI_BATCH];
+    uint8_t  move[AI_BATCH];   /* out */
+} AiBatch;
+
+void aiBatchAdd(AiBatch *b, const Fighter *ai, const Fighter *opp, int stream) {
+    int j = b->n++;
     int hpPct = (ai->hp * 100) / ai->maxHp;
+    b->hp[j]      = (uint8_t)(hpPct < 0 ? 0 : hpPct > 100 ? 100 : hpPct);
+    b->charge[j]  = (uint8_t)ai->charge;
+    b->buff[j]    = ai->buffActive != 0;
+    b->oppBuff[j] = opp->buffActive != 0;
+    b->dot[j]     = (uint8_t)(opp->dotStacks > MAX_DOT_STACKS ? MAX_DOT_STACKS : opp->dotStacks);
+    b->stream[j]  = (uint16_t)stream;
+}
+
+void aiBatchRun(const AiPolicy *p, AiBatch *b, uint32_t *rng) {
+    const uint16_t (*odds)[4] = &p->odds[0][0][0][0][0];
+    int n = b->n;
+    for (int j=0;j<n;j++)
+        b->cell[j] = (uint16_t)aiCellIndex(p, b->hp[j], b->charge[j], b->buff[j], b->oppBuff[j], b->dot[j]);
+    for (int j=0;j<n;j++) {
+        uint16_t s = b->stream[j];
+        b->draw[j] = (rng[s] = rngStep(rng[s])) >> 17;
+    }
+    for (int j=0;j<n;j++) {
+        const uint16_t *o = odds[b->cell[j]];
+        uint32_t r = b->draw[j];
+        b->move[j] = (uint8_t)((r >= o[0]) + (r >= o[1]) + (r >= o[2]) + (r >= o[3]));
+    }
+}
 
-    if (ai->charge == MAX_CHARGE && randPct() < 65) return MOVE_ULT;
-    if (hpPct < 25 && randPct() < 60)               return MOVE_DEF;
+/* ===================== MOVE EFFECTS ===================== */
+/*
+ * Effect programs are interpreted here for both the duel and the gauntlet.
+ * The VM owns no memory: the program is read-only bytes and all state is in
+ * the FxCtx. Dispatch is a computed goto on GCC/Clang, a switch elsewhere.
+ */
+#define FXF_NO_SPLIT 1   /* gauntlet enemies don't transmute */
 
-    if (opp->buffActive) {
-        int r = randPct();
-        if (r < 45) return MOVE_ATK;
-        if (r < 70 && ai->charge >= 3) return MOVE_DOT;
+typedef struct {
+    Fighter    *att, *def;
+    double      mult;    /* from the defender's move (guard, off-guard...) */
+    const char *tag;     /* appended to the hit line, may be "" */
+    int         flags;
+    BattleLog  *log;
+} FxCtx;
+
+void runFx(const uint8_t *pc, FxCtx *c) {
+    Fighter *att = c->att, *def = c->def;
+#if defined(__GNUC__)
+    static const void *fxOps[FX_OP_COUNT] = { &&op_end, &&op_hit, &&op_sunder, &&op_split };
+#define FX_DISPATCH() goto *fxOps[*pc++]
+#else
+#define FX_DISPATCH() switch (*pc++) { case FX_HIT: goto op_hit; case FX_SUNDER: goto op_sunder; \
+                                       case FX_SPLIT: goto op_split; default: goto op_end; }
+#endif
+    FX_DISPATCH();
+
+op_hit: {
+        int dStat = eDef(def);
+        int crit  = rollPct(att->crt);
+        int dmg   = calcDamage(BAL(pc[0]), eAtk(att), dStat / pc[1]);
+        if (crit) dmg = dmg*pc[2]/pc[3];
+        dmg = (int)(dmg*c->mult); if (dmg<1) dmg=1;
+        def->hp -= dmg;
+        LOGF(c->log, "%sULTIMATE! %s -> %s: %d dmg%s",
+            crit?"CRIT! ":"", att->name, def->name, dmg, c->tag);
+        pc += 4;
+        FX_DISPATCH();
+    }
+op_sunder:
+    def->defPenalty += pc[0];
+    if (def->defPenalty > MAX_SUNDER) def->defPenalty = MAX_SUNDER;
+    LOGF(c->log, "Armor sundered! %s -%d DEF permanently", def->name, pc[0]);
+    pc += 1;
+    FX_DISPATCH();
+op_split:
+    if (!(c->flags & FXF_NO_SPLIT) && def->hp>0) {
+        int total=att->hp+def->hp; if(total<0)total=0;
+        int na=total*pc[0]/100, nd=total-na;
+        if(na>att->maxHp)na=att->maxHp;
+        att->hp=na; def->hp=nd;
+        LOGF(c->log, "Transmutation! HP split: %s=%d, %s=%d",
+            att->name,att->hp,def->name,def->hp);
     }
-    if (opp->dotStacks < MAX_DOT_STACKS && ai->charge >= 3 && randPct() < 35)
-        return MOVE_DOT;
-    if (!ai->buffActive && ai->charge >= 2 && hpPct > 40 && randPct() < 40)
-        return MOVE_BUFF;
-    if (ai->charge >= 7 && ai->charge < MAX_CHARGE && randPct() < 25)
-        return MOVE_DEF;
-    return MOVE_ATK;
+    pc += 1;
+    FX_DISPATCH();
+op_end:
+    return;
+#undef FX_DISPATCH
 }
 
 /* ===================== RESOLVE TURN ===================== */
@@ -237,87 +925,62 @@ void resolveTurn(Fighter *a, Fighter *b, int moveA, int moveB, BattleLog *log) {
     int typeA = movesA[moveA].type;
     int typeB = movesB[moveB].type;
 
-    char buf[128];
-    snprintf(buf, 128, "%s used %s", a->name, movesA[moveA].name); logAdd(log, buf);
-    snprintf(buf, 128, "%s used %s", b->name, movesB[moveB].name); logAdd(log, buf);
+    LOGF(log, "%s used %s", a->name, movesA[moveA].name);
+    LOGF(log, "%s used %s", b->name, movesB[moveB].name);
 
     for (int dir = 0; dir < 2; dir++) {
         Fighter *att = (dir==0)?a:b, *def=(dir==0)?b:a;
         int myT  = (dir==0)?typeA:typeB;
         int oppT = (dir==0)?typeB:typeA;
         int aStat = eAtk(att), dStat = eDef(def);
-        int dodge = 5 + eSpd(def);
+        int dodge = BAL(BAL_DODGE) + eSpd(def);
 
         if (myT == MOVE_ATK) {
-            if (randPct() < dodge) {
-                snprintf(buf,128,"%s dodged!", def->name); logAdd(log,buf);
+            if (rollPct(dodge)) {
+                LOGF(log, "%s dodged!", def->name);
             } else {
                 double mult = 1.0;
                 if (oppT==MOVE_DEF)  mult=0.5;
                 if (oppT==MOVE_BUFF) mult=1.3;
-                int crit = (randPct() < att->crt);
-                int dmg  = calcDamage(BASE_ATK_DAMAGE[att->classId], aStat, dStat);
+                int crit = rollPct(att->crt);
+                int dmg  = calcDamage(BAL(BAL_ATK_KNIGHT+att->classId), aStat, dStat);
                 if (crit) dmg = dmg*3/2;
                 dmg = (int)(dmg*mult); if(dmg<1)dmg=1;
                 def->hp -= dmg;
-                snprintf(buf,128,"%s%s -> %s: %d dmg%s",
+                LOGF(log, "%s%s -> %s: %d dmg%s",
                     crit?"CRIT! ":"", att->name, def->name, dmg,
                     oppT==MOVE_DEF?" (blocked)":oppT==MOVE_BUFF?" (off-guard)":"");
-                logAdd(log,buf);
             }
         }
 
         if (myT == MOVE_DOT) {
             if (oppT == MOVE_ATK) {
-                snprintf(buf,128,"%s's DoT interrupted!", att->name); logAdd(log,buf);
-            } else if (randPct() < dodge) {
-                snprintf(buf,128,"%s evaded DoT!", def->name); logAdd(log,buf);
+                LOGF(log, "%s's DoT interrupted!", att->name);
+            } else if (rollPct(dodge)) {
+                LOGF(log, "%s evaded DoT!", def->name);
             } else {
                 if (def->dotStacks < MAX_DOT_STACKS) def->dotStacks++;
                 def->dotTurns = 3;
-                snprintf(buf,128,"%s: DoT stack %d/3%s", def->name, def->dotStacks,
-                    oppT==MOVE_BUFF?" EMPOWERED!":""); logAdd(log,buf);
+                LOGF(log, "%s: DoT stack %d/3%s", def->name, def->dotStacks,
+                    oppT==MOVE_BUFF?" EMPOWERED!":"");
             }
         }
 
         if (myT == MOVE_BUFF) {
             if (oppT == MOVE_DEF) {
-                snprintf(buf,128,"%s's buff suppressed!", att->name); logAdd(log,buf);
+                LOGF(log, "%s's buff suppressed!", att->name);
             } else {
                 att->buffActive=1; att->buffTurns=3;
                 static const char *sn[3]={"DEF","SPD","ATK"};
-                snprintf(buf,128,"%s buffed! +%d %s (3T)", att->name, att->buffAmt, sn[att->buffStat]);
-                logAdd(log,buf);
+                LOGF(log, "%s buffed! +%d %s (3T)", att->name, att->buffAmt, sn[att->buffStat]);
             }
         }
 
         if (myT == MOVE_ULT) {
-            double mult=1.0;
-            if (oppT==MOVE_DEF)  mult=0.25;
-            if (oppT==MOVE_BUFF) mult=1.25;
-            int effDef = (att->classId==CLASS_MAGICIAN)?dStat/2:dStat;
-            int crit   = (randPct()<att->crt);
-            int dmg    = calcDamage(BASE_ULT_DAMAGE[att->classId], aStat, effDef);
-            if (crit) dmg=dmg*7/5;
-            dmg=(int)(dmg*mult); if(dmg<1)dmg=1;
-            def->hp -= dmg;
-            snprintf(buf,128,"%sULTIMATE! %s -> %s: %d dmg%s",
-                crit?"CRIT! ":"", att->name, def->name, dmg,
-                oppT==MOVE_DEF?" (deflected)":""); logAdd(log,buf);
-
-            if (att->classId==CLASS_KNIGHT) {
-                def->defPenalty+=2;
-                snprintf(buf,128,"Armor sundered! %s -2 DEF permanently", def->name);
-                logAdd(log,buf);
-            }
-            if (att->classId==CLASS_ALCHEMIST && def->hp>0) {
-                int total=att->hp+def->hp; if(total<0)total=0;
-                int na=total*6/10, nd=total-na;
-                if(na>att->maxHp)na=att->maxHp;
-                att->hp=na; def->hp=nd;
-                snprintf(buf,128,"Transmutation! HP split: %s=%d, %s=%d",
-                    att->name,att->hp,def->name,def->hp); logAdd(log,buf);
-            }
+            Move *m = (dir==0) ? &movesA[moveA] : &movesB[moveB];
+            FxCtx c = { att, def, oppT==MOVE_DEF ? 0.25 : oppT==MOVE_BUFF ? 1.25 : 1.0,
+                        oppT==MOVE_DEF ? " (deflected)" : "", 0, log };
+            runFx(m->fx, &c);
         }
     }
 
@@ -325,18 +988,17 @@ void resolveTurn(Fighter *a, Fighter *b, int moveA, int moveB, BattleLog *log) {
     for (int dir=0;dir<2;dir++) {
         Fighter *f=(dir==0)?a:b, *src=(dir==0)?b:a;
         if (f->dotStacks>0 && f->dotTurns>0) {
-            int tick=calcDotTick(DOT_BASE[f->dotStacks-1],eAtk(src),eDef(f));
+            int tick=calcDotTick(BAL(BAL_DOT_1+f->dotStacks-1),eAtk(src),eDef(f));
             f->hp-=tick; f->dotTurns--;
-            snprintf(buf,128,"DoT: %s burned %d (%dT left)",f->name,tick,f->dotTurns);
-            logAdd(log,buf);
+            LOGF(log, "DoT: %s burned %d (%dT left)",f->name,tick,f->dotTurns);
             if(f->dotTurns==0){ f->dotStacks=0;
-                snprintf(buf,128,"%s's DoT faded",f->name); logAdd(log,buf); }
+                LOGF(log, "%s's DoT faded",f->name); }
         }
     }
 
     /* Charge */
-    int ga=CHARGE_GAIN[typeA]-movesA[moveA].cost;
-    int gb=CHARGE_GAIN[typeB]-movesB[moveB].cost;
+    int ga=BAL(BAL_GAIN_ATK+typeA)-movesA[moveA].cost;
+    int gb=BAL(BAL_GAIN_ATK+typeB)-movesB[moveB].cost;
     a->charge+=ga; b->charge+=gb;
     if(a->charge>MAX_CHARGE)a->charge=MAX_CHARGE;
     if(b->charge>MAX_CHARGE)b->charge=MAX_CHARGE;
@@ -348,16 +1010,158 @@ void resolveTurn(Fighter *a, Fighter *b, int moveA, int moveB, BattleLog *log) {
         Fighter *f=(dir==0)?a:b;
         if(f->buffActive && --f->buffTurns<=0){
             f->buffActive=0;
-            snprintf(buf,128,"%s's buff expired",f->name); logAdd(log,buf);
+            LOGF(log, "%s's buff expired",f->name);
+        }
+    }
+}
+
+/* ===================== BATCHED DUELS ===================== */
+/*
+ * AI-vs-AI duels run DUEL_BATCH at a time, one turn of all of them per tick,
+ * so the policy is evaluated for the whole batch at once (aiBatchRun) rather
+ * than once per match per turn. Each match keeps its own RNG word and sees
+ * the same sequence as a lone simulateDuel with its seed.
+ */
+#define DUEL_BATCH (AI_BATCH/2)
+
+typedef struct {
+    int      n, running;
+    Fighter  a[DUEL_BATCH], b[DUEL_BATCH];
+    uint32_t rng[DUEL_BATCH];
+    uint8_t  turns[DUEL_BATCH];
+    uint8_t  live[DUEL_BATCH];   /* matches not yet over, first `running` */
+    AiBatch  ai;
+} DuelBatch;
+
+/* Adds a match (n must be below DUEL_BATCH); clear n and running to start a new batch */
+void duelBatchAdd(DuelBatch *d, int classA, int classB, uint32_t seed) {
+    int i = d->n++;
+    uint32_t keep = gRng;
+    seedRng(seed);
+    initFighter(&d->a[i], "A", classA);
+    initFighter(&d->b[i], "B", classB);
+    d->rng[i] = gRng;
+    d->turns[i] = 0;
+    d->live[d->running++] = (uint8_t)i;
+    gRng = keep;
+}
+
+/* One turn of every match still running; returns how many still are */
+int duelBatchTick(DuelBatch *d, const AiPolicy *p) {
+    AiBatch *ai = &d->ai;
+    ai->n = 0;
+    for (int k=0;k<d->running;k++) {
+        int i = d->live[k];
+        aiBatchAdd(ai, &d->a[i], &d->b[i], i);
+        aiBatchAdd(ai, &d->b[i], &d->a[i], i);
+    }
+    aiBatchRun(p, ai, d->rng);
+
+    uint32_t keep = gRng;
+    for (int k=0;k<d->running;k++) {
+        int i = d->live[k];
+        gRng = d->rng[i];
+        resolveTurn(&d->a[i], &d->b[i], ai->move[2*k], ai->move[2*k+1], NULL);
+        d->rng[i] = gRng;
+        d->turns[i]++;
+    }
+    gRng = keep;
+    for (int k=0;k<d->running;) {   /* drop finished matches */
+        int i = d->live[k];
+        if (d->turns[i] == MAX_TURNS || d->a[i].hp <= 0 || d->b[i].hp <= 0) d->live[k] = d->live[--d->running];
+        else k++;
+    }
+    return d->running;
+}
+
+/* As simulateDuel: 1 P1 win, 1/2 draw, 0 loss */
+double duelBatchScore(const DuelBatch *d, int i) {
+    const Fighter *a = &d->a[i], *b = &d->b[i];
+    int d1 = a->hp<=0, d2 = b->hp<=0;
+    if (d1 || d2) return (d1 && d2) ? 0.5 : d2;
+    return a->hp>b->hp ? 1 : a->hp<b->hp ? 0 : 0.5;
+}
+
+/* n duels of one matchup, seed[i] each, to the end; turns may be NULL */
+void simulateDuels(int classA, int classB, const uint32_t *seed, int n, double *score, int *turns) {
+    static _Thread_local DuelBatch d;
+    const AiPolicy *p = aiActive();
+    for (int at=0; at<n; at+=DUEL_BATCH) {
+        d.n = d.running = 0;
+        for (int i=at; i<n && i<at+DUEL_BATCH; i++) duelBatchAdd(&d, classA, classB, seed[i]);
+        while (duelBatchTick(&d, p)) {}
+        for (int i=0;i<d.n;i++) {
+            score[at+i] = duelBatchScore(&d, i);
+            if (turns) turns[at+i] = d.turns[i];
         }
     }
 }
 
+/* ===================== UI BATCH ===================== */
+/*
+ * HUD rectangles and text are queued during the frame and issued together by
+ * uiFlush(): every shape first, then every string. Raylib already merges
+ * consecutive draws that share a texture, but each switch between the shapes
+ * texture and the font atlas (bar, label, bar, label...) and each switch to
+ * line primitives ends the batch, so the unsorted HUD cost one draw call per
+ * widget. Outlines go in as four 1px quads for the same reason. Sprites are
+ * drawn immediately, so layering is always sprites < shapes < text.
+ */
+#define UI_MAX_RECTS  4096
+#define UI_MAX_TEXTS  1024
+#define UI_TEXT_BYTES 32768
+
+typedef struct { float x, y, w, h; Color c; } UiRect;
+typedef struct { int x, y, size, off; Color c; } UiText;
+
+typedef struct {
+    UiRect rects[UI_MAX_RECTS];
+    UiText texts[UI_MAX_TEXTS];
+    char   chars[UI_TEXT_BYTES];
+    int    rectCount, textCount, charCount;
+} UiBatch;
+
+static UiBatch gUi;
+
+void uiFlush(void) {
+    for (int i=0;i<gUi.rectCount;i++) {
+        UiRect *r = &gUi.rects[i];
+        DrawRectangleRec((Rectangle){r->x, r->y, r->w, r->h}, r->c);
+    }
+    for (int i=0;i<gUi.textCount;i++) {
+        UiText *t = &gUi.texts[i];
+        DrawTextEx(gFont, gUi.chars + t->off, (Vector2){(float)t->x,(float)t->y}, (float)t->size, 1.0f, t->c);
+    }
+    gUi.rectCount = gUi.textCount = gUi.charCount = 0;
+}
+
+void uiRect(int x, int y, int w, int h, Color c) {
+    if (w <= 0 || h <= 0) return;
+    if (gUi.rectCount == UI_MAX_RECTS) uiFlush();
+    gUi.rects[gUi.rectCount++] = (UiRect){(float)x, (float)y, (float)w, (float)h, c};
+}
+
+void uiRectLines(int x, int y, int w, int h, Color c) {
+    uiRect(x,     y,     w, 1,   c);
+    uiRect(x,     y+h-1, w, 1,   c);
+    uiRect(x,     y+1,   1, h-2, c);
+    uiRect(x+w-1, y+1,   1, h-2, c);
+}
+
+void uiText(const char *text, int x, int y, int size, Color c) {
+    int n = (int)strlen(text) + 1;
+    if (n > UI_TEXT_BYTES) return;
+    if (gUi.textCount == UI_MAX_TEXTS || gUi.charCount + n > UI_TEXT_BYTES) uiFlush();
+    memcpy(gUi.chars + gUi.charCount, text, (size_t)n);
+    gUi.texts[gUi.textCount++] = (UiText){x, y, size, gUi.charCount, c};
+    gUi.charCount += n;
+}
+
 /* ===================== FONT WRAPPERS ===================== */
 /* Use gFont everywhere so swapping the font file changes all text at once */
 
 void FDrawText(const char *text, int x, int y, int size, Color color) {
-    DrawTextEx(gFont, text, (Vector2){(float)x,(float)y}, (float)size, 1.0f, color);
+    uiText(text, x, y, size, color);
 }
 
 int FMeasureText(const char *text, int size) {
@@ -365,10 +1169,182 @@ int FMeasureText(const char *text, int size) {
     return (int)v.x;
 }
 
+/* ===================== LAYOUT ===================== */
+/*
+ * Every widget position lives here, computed once per window size instead of
+ * being re-derived inside the draw calls. The logical canvas is always SH
+ * tall; its width follows the window's aspect ratio (clamped to LAYOUT_MIN_W
+ * .. LAYOUT_MAX_W, beyond that the scaler letterboxes), so edge-anchored
+ * widgets spread out on wide screens. Sizes stay in 1280x720 units.
+ */
+#define LAYOUT_MIN_W 960
+#define LAYOUT_MAX_W 2560
+#define SPRITE_SCALE 3.0f
+
+typedef struct {
+    int winW, winH;          /* window size this layout was computed for */
+    int w, h, cx;            /* logical canvas */
+
+    /* duel screens */
+    Rectangle hp[2];         /* P1 bar fills LTR, P2 bar RTL */
+    Vector2   pips[2];       /* P1 left-aligned, P2 right-aligned */
+    int       turnY;
+    Vector2   sprite[2];     /* x = centre, y = top */
+    int       tagsX[2], tagsY[2][3];   /* status tags under sprite [player][class] */
+    Vector2   menu[2];       /* move menu under P1 / P2 */
+    int       menuW, menuHdrY;
+    Rectangle log;
+    int       promptY;
+
+    /* gauntlet screens */
+    Rectangle gHp;
+    Vector2   gPips;
+    int       gTurnY;
+    int       enemyX[3], enemyY;
+    int       miniBarW, miniBarY, miniLabelY, miniPipsY, miniTagsY;
+    int       targetHintY;
+    Vector2   gMenu;
+    Rectangle gLog;
+    int       gPromptY;
+    Vector2   coopMenu[2];   /* co-op: one menu per champion, bars use hp[]/pips[] */
+    int       coopHdrY;
+} Layout;
+
+static Layout gLayout;
+
+/* Needs the sprites loaded: status tags sit under the sprite's real height */
+void layoutCompute(Layout *L, int winW, int winH) {
+    memset(L, 0, sizeof(*L));
+    L->winW = winW; L->winH = winH;
+    L->h = SH;
+    L->w = (winH > 0) ? (int)((long)SH * winW / winH) : SW;
+    if (L->w < LAYOUT_MIN_W) L->w = LAYOUT_MIN_W;
+    if (L->w > LAYOUT_MAX_W) L->w = LAYOUT_MAX_W;
+    int w = L->w, cx = L->cx = w/2;
+
+    L->hp[0]     = (Rectangle){30,    20, 380, 22};
+    L->hp[1]     = (Rectangle){w-410, 20, 380, 22};
+    L->pips[0]   = (Vector2){30,   62};
+    L->pips[1]   = (Vector2){w-30, 62};
+    L->turnY     = 20;
+    L->sprite[0] = (Vector2){250,   110};
+    L->sprite[1] = (Vector2){w-250, 110};
+    for (int p=0;p<2;p++) {
+        L->tagsX[p] = (int)L->sprite[p].x - 48;
+        for (int c=0;c<3;c++)
+            L->tagsY[p][c] = (int)L->sprite[p].y + (int)(gSprites[p][c].height * SPRITE_SCALE) + 6;
+    }
+    L->menuW    = 560;
+    L->menuHdrY = 330;
+    L->menu[0]  = (Vector2){20,    355};
+    L->menu[1]  = (Vector2){w-580, 355};
+    L->log      = (Rectangle){cx-280, 355, 560, MAX_LOG_LINES*21+16};
+    L->promptY  = 660;
+
+    L->gHp    = (Rectangle){cx-300, 12, 600, 26};
+    L->gPips  = (Vector2){cx-115, 52};
+    L->gTurnY = 76;
+    L->enemyX[0] = 160; L->enemyX[1] = cx; L->enemyX[2] = w-160;
+    L->enemyY     = 100;
+    L->miniBarW   = 140;
+    L->miniBarY   = L->enemyY + 220;
+    L->miniLabelY = L->enemyY + 235;
+    L->miniPipsY  = L->enemyY + 252;
+    L->miniTagsY  = L->enemyY + 264;
+    L->targetHintY = 300;
+    L->gMenu    = (Vector2){cx-280, 330};
+    L->gLog     = (Rectangle){cx-300, 330, 600, MAX_LOG_LINES*21+16};
+    L->gPromptY = 680;
+    L->coopHdrY    = 392;
+    L->coopMenu[0] = (Vector2){20,    415};
+    L->coopMenu[1] = (Vector2){w-580, 415};
+}
+
+/* Recompute after a resize or F11. Returns 1 if the layout changed. */
+int layoutRefresh(Layout *L) {
+    int ww = GetScreenWidth(), wh = GetScreenHeight();
+    if (ww == L->winW && wh == L->winH) return 0;
+    layoutCompute(L, ww, wh);
+    return 1;
+}
+
+/* ===================== HUD TEXT CACHE ===================== */
+/*
+ * HUD numbers change at most once per turn, so their strings and measured
+ * widths are rebuilt only when GameState.version moves, not every frame.
+ * Per-class move menu text never changes and is built once after font load.
+ */
+typedef struct { char s[64]; int w; } HudText;
+
+enum { HUD_P1, HUD_P2, HUD_ENEMY0, HUD_SLOTS = HUD_ENEMY0+3 };
+
+typedef struct {
+    int      valid;
+    unsigned version;
+    HudText  hp[HUD_SLOTS];
+    HudText  buff[HUD_SLOTS], dot[HUD_SLOTS];
+    HudText  turn;
+    HudText  header[2];      /* "<name> - Choose your move:" for p1 / p2 */
+    HudText  result[2];      /* "<name>: N HP remaining" */
+} HudCache;
+
+typedef struct {
+    HudText info[3][5];      /* "Cost:N +N" per class and move slot */
+    int     badgeW[5], lockedW, ultReadyW;
+} HudStatic;
+
+static HudCache  gHud;
+static HudStatic gHudStatic;
+
+static const char *MOVE_TYPE_TAG[5] = {"ATK","DEF","DoT","Buff","Ult"};
+
+void hudText(HudText *t, int size, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(t->s, sizeof(t->s), fmt, ap);
+    va_end(ap);
+    t->w = FMeasureText(t->s, size);
+}
+
+void hudInitStatic(HudStatic *hs) {
+    for (int c=0;c<3;c++) {
+        Move *moves = getMoves(c);
+        for (int i=0;i<5;i++)
+            hudText(&hs->info[c][i], 15, "Cost:%d +%d", moves[i].cost, BAL(BAL_GAIN_ATK+moves[i].type));
+    }
+    for (int t=0;t<5;t++) hs->badgeW[t] = FMeasureText(MOVE_TYPE_TAG[t], 14);
+    hs->lockedW   = FMeasureText("[LOCKED]", 14);
+    hs->ultReadyW = FMeasureText("ULTIMATE READY!", 16);
+}
+
+void hudRefresh(HudCache *hc, const GameState *gs) {
+    if (hc->valid && hc->version == gs->version) return;
+    hc->valid = 1;
+    hc->version = gs->version;
+
+    const Fighter *f[HUD_SLOTS] = {&gs->p1, &gs->p2, &gs->enemies[0], &gs->enemies[1], &gs->enemies[2]};
+    for (int i=0;i<HUD_SLOTS;i++) {
+        int hp = f[i]->hp>0 ? f[i]->hp : 0;
+        if      (i==HUD_P1) hudText(&hc->hp[i], 19, "%s  %d/%d", f[i]->name, hp, f[i]->maxHp);
+        else if (i==HUD_P2) hudText(&hc->hp[i], 19, "%d/%d  %s", hp, f[i]->maxHp, f[i]->name);
+        else                hudText(&hc->hp[i], 13, "%s %d/%d", f[i]->name, hp, f[i]->maxHp);
+        hudText(&hc->buff[i], 13, "BUFF %dT", f[i]->buffTurns);
+        hudText(&hc->dot[i],  13, "DoT%d %dT", f[i]->dotStacks, f[i]->dotTurns);
+    }
+    if (gs->endless)      hudText(&hc->turn, 18, "ENDLESS - Wave %d - Turn %d - Kills %d", gs->wave, gs->turn, endlessKills(gs));
+    else if (gs->coop)    hudText(&hc->turn, 18, "CO-OP GAUNTLET - Turn %d/%d", gs->turn, MAX_TURNS);
+    else if (gs->gauntletMode) hudText(&hc->turn, 18, "GAUNTLET - Turn %d/%d", gs->turn, MAX_TURNS);
+    else                  hudText(&hc->turn, 20, "Turn %d/%d", gs->turn, MAX_TURNS);
+    for (int i=0;i<2;i++) {
+        hudText(&hc->header[i], 18, "%s - Choose your move:", f[i]->name);
+        hudText(&hc->result[i], 20, "%s: %d HP remaining", f[i]->name, f[i]->hp>0?f[i]->hp:0);
+    }
+}
+
 /* ===================== DRAWING ===================== */
 
 /* HP bar: x,y = top-left, w=width, h=height, fills left to right */
-void drawHPBar(int x, int y, int w, int h, int hp, int maxHp, const char *label) {
+void drawHPBar(int x, int y, int w, int h, int hp, int maxHp, const HudText *txt) {
     float ratio = (maxHp>0) ? (float)hp/(float)maxHp : 0;
     if(ratio<0)ratio=0;
     if(ratio>1)ratio=1;
@@ -377,17 +1353,15 @@ void drawHPBar(int x, int y, int w, int h, int hp, int maxHp, const char *label)
     if (ratio < 0.5f) fill = YELLOW;
     if (ratio < 0.25f) fill = RED;
 
-    DrawRectangle(x, y, w, h, (Color){40,40,40,255});        /* bg */
-    DrawRectangle(x, y, (int)(w*ratio), h, fill);             /* fill */
-    DrawRectangleLines(x, y, w, h, (Color){180,180,180,255}); /* border */
+    uiRect(x, y, w, h, (Color){40,40,40,255});        /* bg */
+    uiRect(x, y, (int)(w*ratio), h, fill);             /* fill */
+    uiRectLines(x, y, w, h, (Color){180,180,180,255}); /* border */
 
-    char txt[64];
-    snprintf(txt, 64, "%s  %d/%d", label, hp>0?hp:0, maxHp);
-    FDrawText(txt, x+5, y+h+4, 19, WHITE);
+    FDrawText(txt->s, x+5, y+h+4, 19, WHITE);
 }
 
 /* HP bar filling right to left (for player 2) */
-void drawHPBarRTL(int x, int y, int w, int h, int hp, int maxHp, const char *label) {
+void drawHPBarRTL(int x, int y, int w, int h, int hp, int maxHp, const HudText *txt) {
     float ratio = (maxHp>0) ? (float)hp/(float)maxHp : 0;
     if(ratio<0)ratio=0;
     if(ratio>1)ratio=1;
@@ -397,14 +1371,11 @@ void drawHPBarRTL(int x, int y, int w, int h, int hp, int maxHp, const char *lab
     if (ratio < 0.25f) fill = RED;
 
     int fillW = (int)(w*ratio);
-    DrawRectangle(x, y, w, h, (Color){40,40,40,255});
-    DrawRectangle(x + w - fillW, y, fillW, h, fill);
-    DrawRectangleLines(x, y, w, h, (Color){180,180,180,255});
+    uiRect(x, y, w, h, (Color){40,40,40,255});
+    uiRect(x + w - fillW, y, fillW, h, fill);
+    uiRectLines(x, y, w, h, (Color){180,180,180,255});
 
-    char txt[64];
-    snprintf(txt, 64, "%d/%d  %s", hp>0?hp:0, maxHp, label);
-    int tw = FMeasureText(txt, 19);
-    FDrawText(txt, x+w-tw-5, y+h+4, 19, WHITE);
+    FDrawText(txt->s, x+w-txt->w-5, y+h+4, 19, WHITE);
 }
 
 /* Charge pips: 10 small squares */
@@ -416,20 +1387,17 @@ void drawChargePips(int x, int y, int charge, int align) {
     for (int i=0;i<MAX_CHARGE;i++) {
         int px = startX + i*(pipW+gap);
         Color c = (i < charge) ? (Color){255,220,50,255} : (Color){50,50,50,255};
-        DrawRectangle(px, y, pipW, pipH, c);
-        DrawRectangleLines(px, y, pipW, pipH, (Color){120,120,120,255});
+        uiRect(px, y, pipW, pipH, c);
+        uiRectLines(px, y, pipW, pipH, (Color){120,120,120,255});
     }
 
     if (charge == MAX_CHARGE) {
-        const char *ultTxt = "ULTIMATE READY!";
-        int tw = FMeasureText(ultTxt, 16);
         int tx = (align==1) ? x-totalW : x;
-        FDrawText(ultTxt, tx + totalW/2 - tw/2, y+pipH+3, 16, (Color){255,80,80,255});
+        FDrawText("ULTIMATE READY!", tx + totalW/2 - gHudStatic.ultReadyW/2, y+pipH+3, 16, (Color){255,80,80,255});
     }
 }
 
 /* Draw a fighter's sprite scaled up. If dead, draw nothing. */
-#define SPRITE_SCALE 3.0f
 void drawSprite(int playerIdx, int classId, int x, int y, int dead) {
     if (dead) return;
     Texture2D tex = gSprites[playerIdx][classId];
@@ -437,26 +1405,24 @@ void drawSprite(int playerIdx, int classId, int x, int y, int dead) {
     DrawTextureEx(tex, (Vector2){x - drawW/2, (float)y}, 0.0f, SPRITE_SCALE, WHITE);
 }
 
-/* Status tags (buff/dot) drawn under sprite */
-void drawStatusTags(int x, int y, Fighter *f) {
+/* Status tags (buff/dot) drawn under sprite; slot picks the cached text */
+void drawStatusTags(int x, int y, Fighter *f, int slot) {
     int ox=x, fs=13;
     if (f->buffActive) {
-        char b[32]; snprintf(b,32,"BUFF %dT",f->buffTurns);
-        DrawRectangle(ox,y,60,18,(Color){30,80,180,200});
-        FDrawText(b,ox+3,y+2,fs,(Color){180,220,255,255});
+        uiRect(ox,y,60,18,(Color){30,80,180,200});
+        FDrawText(gHud.buff[slot].s,ox+3,y+2,fs,(Color){180,220,255,255});
         ox+=65;
     }
     if (f->dotStacks>0) {
-        char b[32]; snprintf(b,32,"DoT%d %dT",f->dotStacks,f->dotTurns);
-        DrawRectangle(ox,y,65,18,(Color){180,50,20,200});
-        FDrawText(b,ox+3,y+2,fs,(Color){255,180,100,255});
+        uiRect(ox,y,65,18,(Color){180,50,20,200});
+        FDrawText(gHud.dot[slot].s,ox+3,y+2,fs,(Color){255,180,100,255});
     }
 }
 
 /* Battle log panel */
 void drawBattleLog(BattleLog *log, int x, int y, int w, int h) {
-    DrawRectangle(x,y,w,h,(Color){15,15,15,230});
-    DrawRectangleLines(x,y,w,h,(Color){80,80,80,255});
+    uiRect(x,y,w,h,(Color){15,15,15,230});
+    uiRectLines(x,y,w,h,(Color){80,80,80,255});
     int ly=y+8, fs=16;
     for (int i=0;i<log->count;i++) {
         FDrawText(log->lines[i], x+8, ly, fs, (Color){200,200,200,255});
@@ -467,7 +1433,7 @@ void drawBattleLog(BattleLog *log, int x, int y, int w, int h) {
 /* Move menu */
 void drawMoveMenu(Fighter *f, int selected, int x, int y, int w) {
     Move *moves = getMoves(f->classId);
-    static const char *tn[5]={"ATK","DEF","DoT","Buff","Ult"};
+    const HudText *info = gHudStatic.info[f->classId];
     static const Color typeColor[5]={
         {220,80,80,255},   /* ATK red    */
         {80,120,220,255},  /* DEF blue   */
@@ -477,36 +1443,31 @@ void drawMoveMenu(Fighter *f, int selected, int x, int y, int w) {
     };
 
     int rowH=40, fs=18, pad=10;
-    DrawRectangle(x,y,w,rowH*5+pad*2,(Color){20,20,20,240});
-    DrawRectangleLines(x,y,w,rowH*5+pad*2,(Color){80,80,80,255});
+    uiRect(x,y,w,rowH*5+pad*2,(Color){20,20,20,240});
+    uiRectLines(x,y,w,rowH*5+pad*2,(Color){80,80,80,255});
 
     for (int i=0;i<5;i++) {
         int ry=y+pad+i*rowH;
         int locked=(f->charge<moves[i].cost);
 
         if (i==selected)
-            DrawRectangle(x+2,ry,w-4,rowH-2,(Color){60,60,80,255});
+            uiRect(x+2,ry,w-4,rowH-2,(Color){60,60,80,255});
 
         Color textC = locked?(Color){80,80,80,255}:WHITE;
 
         /* type badge */
-        DrawRectangle(x+pad,ry+6,38,24, locked?(Color){40,40,40,255}:typeColor[moves[i].type]);
-        int bw=FMeasureText(tn[moves[i].type],14);
-        FDrawText(tn[moves[i].type],x+pad+19-bw/2,ry+9,14,locked?(Color){60,60,60,255}:BLACK);
+        uiRect(x+pad,ry+6,38,24, locked?(Color){40,40,40,255}:typeColor[moves[i].type]);
+        int bw=gHudStatic.badgeW[moves[i].type];
+        FDrawText(MOVE_TYPE_TAG[moves[i].type],x+pad+19-bw/2,ry+9,14,locked?(Color){60,60,60,255}:BLACK);
 
         /* move name */
         FDrawText(moves[i].name, x+pad+50, ry+10, fs, textC);
 
         /* cost & gain */
-        char info[32];
-        snprintf(info,32,"Cost:%d +%d",moves[i].cost,CHARGE_GAIN[moves[i].type]);
-        int iw=FMeasureText(info,15);
-        FDrawText(info, x+w-iw-pad, ry+11, 15, locked?(Color){60,60,60,255}:(Color){180,180,180,255});
+        FDrawText(info[i].s, x+w-info[i].w-pad, ry+11, 15, locked?(Color){60,60,60,255}:(Color){180,180,180,255});
 
-        if (locked) {
-            int lw=FMeasureText("[LOCKED]",14);
-            FDrawText("[LOCKED]", x+w-lw-pad-90, ry+12, 14, (Color){150,50,50,255});
-        }
+        if (locked)
+            FDrawText("[LOCKED]", x+w-gHudStatic.lockedW-pad-90, ry+12, 14, (Color){150,50,50,255});
 
         if (i==selected && !locked)
             FDrawText(">", x+w-16, ry+10, fs, (Color){255,220,50,255});
@@ -519,7 +1480,7 @@ void drawMoveMenu(Fighter *f, int selected, int x, int y, int w) {
 /* ===================== SCREEN RENDERERS ===================== */
 
 void drawMenuScreen(void) {
-    int cx=SW/2;
+    int cx=gLayout.cx;
     FDrawText("TRIAL BY COMBAT", cx-FMeasureText("TRIAL BY COMBAT",48)/2, 180, 48, WHITE);
     FDrawText("1  VS COMPUTER", cx-FMeasureText("1  VS COMPUTER",28)/2, 320, 28, (Color){200,200,200,255});
     FDrawText("2  VS PLAYER",   cx-FMeasureText("2  VS PLAYER",28)/2,   370, 28, (Color){200,200,200,255});
@@ -528,7 +1489,7 @@ void drawMenuScreen(void) {
 }
 
 void drawClassSelectScreen(const char *label, int hoveredClass) {
-    int cx=SW/2;
+    int cx=gLayout.cx;
     FDrawText(label, cx-FMeasureText(label,32)/2, 80, 32, WHITE);
 
     static const char *names[3]={"Knight","Magician","Alchemist"};
@@ -546,11 +1507,11 @@ void drawClassSelectScreen(const char *label, int hoveredClass) {
     for (int i=0;i<3;i++) {
         int bx=cx-280, by=180+i*140, bw=560, bh=120;
         int hovered=(hoveredClass==i);
-        DrawRectangle(bx,by,bw,bh, hovered?(Color){40,40,70,255}:(Color){20,20,30,255});
-        DrawRectangleLines(bx,by,bw,bh, hovered?(Color){200,200,255,255}:(Color){80,80,80,255});
+        uiRect(bx,by,bw,bh, hovered?(Color){40,40,70,255}:(Color){20,20,30,255});
+        uiRectLines(bx,by,bw,bh, hovered?(Color){200,200,255,255}:(Color){80,80,80,255});
 
         /* class color swatch */
-        DrawRectangle(bx+10,by+10,60,100, CLASS_COLOR[i]);
+        uiRect(bx+10,by+10,60,100, CLASS_COLOR[i]);
         FDrawText(names[i], bx+80, by+15, 26, WHITE);
         FDrawText(descs[i], bx+80, by+52, 16, (Color){180,180,180,255});
         FDrawText(ultsDesc[i], bx+80, by+80, 16, (Color){220,180,80,255});
@@ -562,7 +1523,7 @@ void drawClassSelectScreen(const char *label, int hoveredClass) {
 }
 
 void drawOpponentSelectScreen(int hovered) {
-    int cx=SW/2;
+    int cx=gLayout.cx;
     FDrawText("Choose Opponent", cx-FMeasureText("Choose Opponent",32)/2, 80, 32, WHITE);
 
     static const char *names[4]={"Knight","Magician","Alchemist","Random"};
@@ -570,8 +1531,8 @@ void drawOpponentSelectScreen(int hovered) {
         int bx=cx-220+i*120, by=300, bw=100, bh=80;
         int h=(hovered==i);
         Color bc = (i<3)?CLASS_COLOR[i]:(Color){100,100,100,255};
-        DrawRectangle(bx,by,bw,bh, h?(Color){bc.r,bc.g,bc.b,255}:(Color){bc.r/3,bc.g/3,bc.b/3,255});
-        DrawRectangleLines(bx,by,bw,bh, h?WHITE:(Color){80,80,80,255});
+        uiRect(bx,by,bw,bh, h?(Color){bc.r,bc.g,bc.b,255}:(Color){bc.r/3,bc.g/3,bc.b/3,255});
+        uiRectLines(bx,by,bw,bh, h?WHITE:(Color){80,80,80,255});
         int nw=FMeasureText(names[i],16);
         FDrawText(names[i], bx+bw/2-nw/2, by+bh/2-8, 16, WHITE);
         char key[4]; snprintf(key,4,"%d",i+1);
@@ -581,34 +1542,30 @@ void drawOpponentSelectScreen(int hovered) {
 }
 
 void drawBattleScreen(GameState *gs) {
+    const Layout *L = &gLayout;
     Fighter *p1=&gs->p1, *p2=&gs->p2;
 
     /* --- TOP UI: HP bars --- */
     /* P1: top-left */
-    drawHPBar(30, 20, 380, 22, p1->hp, p1->maxHp, p1->name);
+    drawHPBar(L->hp[0].x, L->hp[0].y, L->hp[0].width, L->hp[0].height, p1->hp, p1->maxHp, &gHud.hp[HUD_P1]);
     /* P2: top-right, RTL */
-    drawHPBarRTL(SW-410, 20, 380, 22, p2->hp, p2->maxHp, p2->name);
+    drawHPBarRTL(L->hp[1].x, L->hp[1].y, L->hp[1].width, L->hp[1].height, p2->hp, p2->maxHp, &gHud.hp[HUD_P2]);
 
     /* Charge pips */
-    drawChargePips(30, 62, p1->charge, 0);
-    drawChargePips(SW-30, 62, p2->charge, 1);
+    drawChargePips(L->pips[0].x, L->pips[0].y, p1->charge, 0);
+    drawChargePips(L->pips[1].x, L->pips[1].y, p2->charge, 1);
 
     /* Turn counter */
-    char turnTxt[32];
-    snprintf(turnTxt,32,"Turn %d/%d", gs->turn, MAX_TURNS);
-    int tw=FMeasureText(turnTxt,20);
-    FDrawText(turnTxt, SW/2-tw/2, 20, 20, (Color){160,160,160,255});
+    FDrawText(gHud.turn.s, L->cx-gHud.turn.w/2, L->turnY, 20, (Color){160,160,160,255});
 
     /* --- SPRITES --- */
     /* P1: left side */
-    int sp1x=250, spy=110;
-    drawSprite(0, p1->classId, sp1x, spy, p1->hp<=0);
-    drawStatusTags(sp1x-48, spy + (int)(gSprites[0][p1->classId].height * SPRITE_SCALE) + 6, p1);
+    drawSprite(0, p1->classId, L->sprite[0].x, L->sprite[0].y, p1->hp<=0);
+    drawStatusTags(L->tagsX[0], L->tagsY[0][p1->classId], p1, HUD_P1);
 
     /* P2: right side */
-    int sp2x=SW-250, sp2y=110;
-    drawSprite(1, p2->classId, sp2x, sp2y, p2->hp<=0);
-    drawStatusTags(sp2x-48, sp2y + (int)(gSprites[1][p2->classId].height * SPRITE_SCALE) + 6, p2);
+    drawSprite(1, p2->classId, L->sprite[1].x, L->sprite[1].y, p2->hp<=0);
+    drawStatusTags(L->tagsX[1], L->tagsY[1][p2->classId], p2, HUD_P2);
 
     /* --- BATTLE LOG hidden during move selection --- */
     /* (log is shown on the resolve screen after moves are submitted) */
@@ -617,52 +1574,40 @@ void drawBattleScreen(GameState *gs) {
      * P1 choosing -> left side (under P1 sprite)
      * P2 choosing -> right side (under P2 sprite)
      * VS Computer -> always left (P1) */
-    if (!gs->vsComputer && gs->p1chosen) {
-        /* P2's turn: menu on the RIGHT */
-        char hdr[64]; snprintf(hdr,64,"%s - Choose your move:", p2->name);
-        int menuX = SW-580;
-        FDrawText(hdr, menuX, 330, 18, WHITE);
-        drawMoveMenu(p2, gs->selectedMove, menuX, 355, 560);
-    } else {
-        /* P1's turn (or VS computer): menu on the LEFT */
-        Fighter *cf = gs->vsComputer ? p1 : p1;
-        char hdr[64]; snprintf(hdr,64,"%s - Choose your move:", cf->name);
-        FDrawText(hdr, 20, 330, 18, WHITE);
-        drawMoveMenu(cf, gs->selectedMove, 20, 355, 560);
-    }
+    int side = (!gs->vsComputer && gs->p1chosen) ? 1 : 0;
+    Fighter *cf = side ? p2 : p1;
+    FDrawText(gHud.header[side].s, L->menu[side].x, L->menuHdrY, 18, WHITE);
+    drawMoveMenu(cf, gs->selectedMove, L->menu[side].x, L->menu[side].y, L->menuW);
 }
 
 void drawResolveScreen(GameState *gs) {
+    const Layout *L = &gLayout;
     Fighter *p1=&gs->p1, *p2=&gs->p2;
 
     /* HP bars */
-    drawHPBar(30, 20, 380, 22, p1->hp, p1->maxHp, p1->name);
-    drawHPBarRTL(SW-410, 20, 380, 22, p2->hp, p2->maxHp, p2->name);
-    drawChargePips(30, 62, p1->charge, 0);
-    drawChargePips(SW-30, 62, p2->charge, 1);
+    drawHPBar(L->hp[0].x, L->hp[0].y, L->hp[0].width, L->hp[0].height, p1->hp, p1->maxHp, &gHud.hp[HUD_P1]);
+    drawHPBarRTL(L->hp[1].x, L->hp[1].y, L->hp[1].width, L->hp[1].height, p2->hp, p2->maxHp, &gHud.hp[HUD_P2]);
+    drawChargePips(L->pips[0].x, L->pips[0].y, p1->charge, 0);
+    drawChargePips(L->pips[1].x, L->pips[1].y, p2->charge, 1);
 
     /* Sprites */
-    drawSprite(0, p1->classId, 250,    110, p1->hp<=0);
-    drawSprite(1, p2->classId, SW-250, 110, p2->hp<=0);
-    drawStatusTags(202, 110 + (int)(gSprites[0][p1->classId].height * SPRITE_SCALE) + 6, p1);
-    drawStatusTags(SW-298, 110 + (int)(gSprites[1][p2->classId].height * SPRITE_SCALE) + 6, p2);
+    drawSprite(0, p1->classId, L->sprite[0].x, L->sprite[0].y, p1->hp<=0);
+    drawSprite(1, p2->classId, L->sprite[1].x, L->sprite[1].y, p2->hp<=0);
+    drawStatusTags(L->tagsX[0], L->tagsY[0][p1->classId], p1, HUD_P1);
+    drawStatusTags(L->tagsX[1], L->tagsY[1][p2->classId], p2, HUD_P2);
 
     /* Battle log: bottom-center */
-    int logW=560, logH=MAX_LOG_LINES*21+16;
-    drawBattleLog(&gs->log, SW/2-logW/2, 355, logW, logH);
+    drawBattleLog(&gs->log, L->log.x, L->log.y, L->log.width, L->log.height);
 
-    FDrawText("Press ENTER to continue...", SW/2-FMeasureText("Press ENTER to continue...",18)/2, 660, 18, (Color){120,120,120,255});
+    FDrawText("Press ENTER to continue...", L->cx-FMeasureText("Press ENTER to continue...",18)/2, L->promptY, 18, (Color){120,120,120,255});
 }
 
 void drawResultScreen(GameState *gs) {
-    int cx=SW/2;
+    int cx=gLayout.cx;
     FDrawText(gs->resultMsg, cx-FMeasureText(gs->resultMsg,36)/2, 200, 36, WHITE);
 
-    char hp1[64],hp2[64];
-    snprintf(hp1,64,"%s: %d HP remaining", gs->p1.name, gs->p1.hp>0?gs->p1.hp:0);
-    snprintf(hp2,64,"%s: %d HP remaining", gs->p2.name, gs->p2.hp>0?gs->p2.hp:0);
-    FDrawText(hp1, cx-FMeasureText(hp1,20)/2, 260, 20, (Color){180,180,180,255});
-    FDrawText(hp2, cx-FMeasureText(hp2,20)/2, 290, 20, (Color){180,180,180,255});
+    FDrawText(gHud.result[0].s, cx-gHud.result[0].w/2, 260, 20, (Color){180,180,180,255});
+    FDrawText(gHud.result[1].s, cx-gHud.result[1].w/2, 290, 20, (Color){180,180,180,255});
 
     FDrawText("1  Play Again", cx-FMeasureText("1  Play Again",26)/2, 380, 26, (Color){200,200,200,255});
     FDrawText("2  Main Menu",  cx-FMeasureText("2  Main Menu",26)/2,  420, 26, (Color){200,200,200,255});
@@ -692,6 +1637,8 @@ void initGauntlet(GameState *gs) {
     gs->selectedMove  = 0;
     gs->selectedTarget = 0;
     gs->gauntletMode  = 1;
+    gs->endless       = 0;
+    gs->coop          = 0;
     logClear(&gs->log);
 }
 
@@ -705,79 +1652,109 @@ int allEnemiesDead(GameState *gs) {
     return gs->enemies[0].hp<=0 && gs->enemies[1].hp<=0 && gs->enemies[2].hp<=0;
 }
 
-/* Resolve one gauntlet turn */
-void resolveGauntletTurn(GameState *gs) {
-    Fighter *player = &gs->p1;
-    int      move   = gs->gauntletMove;
-    int      tgt    = gs->selectedTarget;
-    char     buf[128];
+/*
+ * ENDLESS: the three enemy slots are a fixed pool. Wave w sends 2+w enemies
+ * through them; a slot whose enemy died is re-initialised in place with the
+ * next one, so nothing is allocated however long a run lasts and a turn
+ * still only resolves the (at most three) living slots. Each wave adds 12%
+ * HP and, every other wave, +1 ATK and DEF. Clearing a wave heals the
+ * player. There is no turn limit; the run ends when the player falls.
+ */
+#define ENDLESS_WAVE_HEAL 30
+
+int endlessWaveSize(int wave) { return 2 + wave; }
 
+/* The ATK/DEF part of a wave's scaling (also reapplied on resume) */
+void endlessStats(Fighter *e, int wave) {
+    e->baseAtk += (wave-1)/2;
+    e->baseDef += (wave-1)/2;
+}
+
+static void endlessSpawn(GameState *gs, Fighter *e) {
+    static const char *en[3] = {"Knight","Magician","Alchemist"};
+    int c = (int)(nextRng() % 3);
+    initFighter(e, en[c], c);
+    e->hp = e->maxHp = e->maxHp * (100 + 12*(gs->wave-1)) / 100;
+    endlessStats(e, gs->wave);
+    gs->waveLeft--;
+    gs->spawned++;
+}
+
+/* After initGauntlet: its three enemies are the first wave's opening */
+void endlessStart(GameState *gs) {
+    gs->endless  = 1;
+    gs->wave     = 1;
+    gs->waveLeft = endlessWaveSize(1) - 3;
+    gs->spawned  = 3;
+}
+
+/* Refills dead slots from the wave; once it's spent and the field is clear,
+ * starts the next wave. Returns 1 when a new wave began. */
+int endlessRefill(GameState *gs) {
+    int fresh = 0;
+    if (gs->waveLeft == 0 && allEnemiesDead(gs)) {
+        gs->wave++;
+        gs->waveLeft = endlessWaveSize(gs->wave);
+        gs->p1.hp += ENDLESS_WAVE_HEAL;
+        if (gs->p1.hp > gs->p1.maxHp) gs->p1.hp = gs->p1.maxHp;
+        fresh = 1;
+    }
+    for (int i=0;i<3 && gs->waveLeft>0;i++)
+        if (gs->enemies[i].hp <= 0) endlessSpawn(gs, &gs->enemies[i]);
+    return fresh;
+}
+
+/* The champion's half of a gauntlet turn: move on enemies[tgt], then its own
+ * charge and buff tick. who names it in the log; NULL is the solo "You". */
+static void gauntletAct(Fighter *player, Fighter *enemies, int move, int tgt, const char *who, BattleLog *log) {
     Move *pmoves = getMoves(player->classId);
-    logAdd(&gs->log, "--- YOUR TURN ---");
-    snprintf(buf,128,"You used %s", pmoves[move].name); logAdd(&gs->log, buf);
+    if (who) LOGF(log, "%s used %s", who, pmoves[move].name);
+    else { LOGF(log, "--- YOUR TURN ---"); LOGF(log, "You used %s", pmoves[move].name); }
 
     /* Player acts on selected target (if alive) */
-    if (tgt >= 0 && tgt < 3 && gs->enemies[tgt].hp > 0) {
-        Fighter *target = &gs->enemies[tgt];
+    if (tgt >= 0 && tgt < 3 && enemies[tgt].hp > 0) {
+        Fighter *target = &enemies[tgt];
         int myT  = pmoves[move].type;
         int aStat = eAtk(player), dStat = eDef(target);
-        int dodge = 5 + eSpd(target);
+        int dodge = BAL(BAL_DODGE) + eSpd(target);
 
         if (myT == MOVE_ATK) {
-            if (randPct() < dodge) {
-                snprintf(buf,128,"%s dodged!", target->name); logAdd(&gs->log,buf);
+            if (rollPct(dodge)) {
+                LOGF(log, "%s dodged!", target->name);
             } else {
-                int crit=(randPct()<player->crt);
-                int dmg=calcDamage(BASE_ATK_DAMAGE[player->classId],aStat,dStat);
+                int crit=rollPct(player->crt);
+                int dmg=calcDamage(BAL(BAL_ATK_KNIGHT+player->classId),aStat,dStat);
                 if(crit) dmg=dmg*3/2;
                 if(dmg<1)dmg=1;
                 target->hp-=dmg;
-                snprintf(buf,128,"%s%s -> %s: %d dmg",crit?"CRIT! ":"",player->name,target->name,dmg);
-                logAdd(&gs->log,buf);
+                LOGF(log, "%s%s -> %s: %d dmg",crit?"CRIT! ":"",player->name,target->name,dmg);
                 if(target->hp<=0){
-                    snprintf(buf,128,"%s defeated! +%d HP",target->name,GAUNTLET_HEAL_REWARD);
-                    logAdd(&gs->log,buf);
+                    LOGF(log, "%s defeated! +%d HP",target->name,GAUNTLET_HEAL_REWARD);
                     player->hp+=GAUNTLET_HEAL_REWARD;
                     if(player->hp>player->maxHp) player->hp=player->maxHp;
                 }
             }
         } else if (myT == MOVE_DOT) {
-            if (randPct() < dodge) {
-                snprintf(buf,128,"%s evaded DoT!", target->name); logAdd(&gs->log,buf);
+            if (rollPct(dodge)) {
+                LOGF(log, "%s evaded DoT!", target->name);
             } else {
                 if(target->dotStacks<MAX_DOT_STACKS) target->dotStacks++;
                 target->dotTurns=3;
-                snprintf(buf,128,"DoT on %s (stack %d/3)",target->name,target->dotStacks);
-                logAdd(&gs->log,buf);
+                LOGF(log, "DoT on %s (stack %d/3)",target->name,target->dotStacks);
             }
         } else if (myT == MOVE_BUFF) {
             player->buffActive=1; player->buffTurns=3;
             static const char *sn[3]={"DEF","SPD","ATK"};
-            snprintf(buf,128,"You buffed! +%d %s",player->buffAmt,sn[player->buffStat]);
-            logAdd(&gs->log,buf);
+            if (who) LOGF(log, "%s buffed! +%d %s",who,player->buffAmt,sn[player->buffStat]);
+            else     LOGF(log, "You buffed! +%d %s",player->buffAmt,sn[player->buffStat]);
         } else if (myT == MOVE_DEF) {
-            snprintf(buf,128,"You brace for impact!"); logAdd(&gs->log,buf);
+            if (who) LOGF(log, "%s braces for impact!", who);
+            else     LOGF(log, "You brace for impact!");
         } else if (myT == MOVE_ULT) {
-            int effDef=(player->classId==CLASS_MAGICIAN)?dStat/2:dStat;
-            int crit=(randPct()<player->crt);
-            int dmg=calcDamage(BASE_ULT_DAMAGE[player->classId],aStat,effDef);
-            if(crit) dmg=dmg*7/5;
-            if(dmg<1)dmg=1;
-            target->hp-=dmg;
-            snprintf(buf,128,"%sULTIMATE -> %s: %d dmg!",crit?"CRIT! ":"",target->name,dmg);
-            logAdd(&gs->log,buf);
-            if(player->classId==CLASS_KNIGHT){ target->defPenalty+=2;
-                snprintf(buf,128,"%s armor sundered! -2 DEF",target->name); logAdd(&gs->log,buf);}
-            if(player->classId==CLASS_ALCHEMIST && target->hp>0){
-                int total=player->hp+target->hp; if(total<0)total=0;
-                int np=total*6/10, nt=total-np;
-                if(np>player->maxHp)np=player->maxHp;
-                player->hp=np; target->hp=nt;
-                snprintf(buf,128,"Transmutation: you=%d, %s=%d",player->hp,target->name,target->hp);
-                logAdd(&gs->log,buf);}
+            FxCtx c = { player, target, 1.0, "", 0, log };
+            runFx(pmoves[move].fx, &c);
             if(target->hp<=0){
-                snprintf(buf,128,"%s defeated! +%d HP",target->name,GAUNTLET_HEAL_REWARD);
-                logAdd(&gs->log,buf);
+                LOGF(log, "%s defeated! +%d HP",target->name,GAUNTLET_HEAL_REWARD);
                 player->hp+=GAUNTLET_HEAL_REWARD;
                 if(player->hp>player->maxHp) player->hp=player->maxHp;
             }
@@ -785,86 +1762,76 @@ void resolveGauntletTurn(GameState *gs) {
     }
 
     /* Charge update for player */
-    int gain = CHARGE_GAIN[pmoves[move].type] - pmoves[move].cost;
+    int gain = BAL(BAL_GAIN_ATK+pmoves[move].type) - pmoves[move].cost;
     player->charge += gain;
     if(player->charge>MAX_CHARGE) player->charge=MAX_CHARGE;
     if(player->charge<0) player->charge=0;
 
     /* Buff tick for player */
     if(player->buffActive && --player->buffTurns<=0){
-        player->buffActive=0; logAdd(&gs->log,"Your buff expired.");}
+        player->buffActive=0;
+        if (who) LOGF(log, "%s's buff expired.", who);
+        else     LOGF(log, "Your buff expired.");
+    }
 
     /* DoT tick on player */
     /* (enemies don't apply DoT to player in this version - they only ATK/DEF/ULT) */
+}
 
-    /* ---- ENEMIES ACT ---- */
-    logAdd(&gs->log, "--- ENEMIES TURN ---");
-    int playerDefending = (pmoves[move].type == MOVE_DEF);
-
-    for (int i=0;i<3;i++) {
-        Fighter *e = &gs->enemies[i];
-        if (e->hp <= 0) continue;
-
-        int emove = chooseMoveAI(e, player);
-        Move *em  = getMoves(e->classId);
-        snprintf(buf,128,"%s: %s", e->name, em[emove].name); logAdd(&gs->log,buf);
+/* One living enemy's action on player; a defending player takes half */
+static void gauntletEnemy(Fighter *e, Fighter *player, int playerDefending, const char *who, BattleLog *log) {
+    int emove = chooseMoveAI(e, player);
+    Move *em  = getMoves(e->classId);
+    LOGF(log, "%s: %s", e->name, em[emove].name);
 
-        int et = em[emove].type;
-        int eDodge = 5 + eSpd(player);
-        int ea = eAtk(e), ed = eDef(player);
+    int et = em[emove].type;
+    int eDodge = BAL(BAL_DODGE) + eSpd(player);
+    int ea = eAtk(e), ed = eDef(player);
 
-        /* If player is defending, reduce incoming by 50% */
-        double defMult = playerDefending ? 0.5 : 1.0;
+    /* If player is defending, reduce incoming by 50% */
+    double defMult = playerDefending ? 0.5 : 1.0;
 
-        if (et == MOVE_ATK) {
-            if (randPct() < eDodge) {
-                logAdd(&gs->log," You dodged!");
-            } else {
-                int crit=(randPct()<e->crt);
-                int dmg=calcDamage(BASE_ATK_DAMAGE[e->classId],ea,ed);
-                if(crit) dmg=dmg*3/2;
-                dmg=(int)(dmg*defMult); if(dmg<1)dmg=1;
-                player->hp-=dmg;
-                snprintf(buf,128,"%s%s deals %d to you%s",crit?"CRIT! ":"",e->name,dmg,playerDefending?" (blocked)":"");
-                logAdd(&gs->log,buf);
-            }
-        } else if (et == MOVE_ULT) {
-            int effDef=(e->classId==CLASS_MAGICIAN)?ed/2:ed;
-            int crit=(randPct()<e->crt);
-            int dmg=calcDamage(BASE_ULT_DAMAGE[e->classId],ea,effDef);
-            if(crit) dmg=dmg*7/5;
+    if (et == MOVE_ATK) {
+        if (rollPct(eDodge)) {
+            if (who) LOGF(log, " %s dodged!", who);
+            else     LOGF(log, " You dodged!");
+        } else {
+            int crit=rollPct(e->crt);
+            int dmg=calcDamage(BAL(BAL_ATK_KNIGHT+e->classId),ea,ed);
+            if(crit) dmg=dmg*3/2;
             dmg=(int)(dmg*defMult); if(dmg<1)dmg=1;
             player->hp-=dmg;
-            snprintf(buf,128,"%s%s ULTIMATE: %d dmg!",crit?"CRIT! ":"",e->name,dmg);
-            logAdd(&gs->log,buf);
-            if(e->classId==CLASS_KNIGHT){ player->defPenalty+=2;
-                snprintf(buf,128,"Your armor sundered! -2 DEF"); logAdd(&gs->log,buf);}
-        } else if (et == MOVE_BUFF) {
-            e->buffActive=1; e->buffTurns=3;
-        } else if (et == MOVE_DEF) {
-            /* enemy defends - just gains charge */
-        }
-        /* Charge for enemy */
-        int eg = CHARGE_GAIN[et] - em[emove].cost;
-        e->charge += eg;
-        if(e->charge>MAX_CHARGE)e->charge=MAX_CHARGE;
-        if(e->charge<0)e->charge=0;
-        /* Buff tick */
-        if(e->buffActive && --e->buffTurns<=0) e->buffActive=0;
-    }
-
-    /* DoT ticks on enemies */
+            LOGF(log, "%s%s deals %d to %s%s",crit?"CRIT! ":"",e->name,dmg,who?who:"you",playerDefending?" (blocked)":"");
+        }
+    } else if (et == MOVE_ULT) {
+        FxCtx c = { e, player, defMult, playerDefending ? " (blocked)" : "", FXF_NO_SPLIT, log };
+        runFx(em[emove].fx, &c);
+    } else if (et == MOVE_BUFF) {
+        e->buffActive=1; e->buffTurns=3;
+    } else if (et == MOVE_DEF) {
+        /* enemy defends - just gains charge */
+    }
+    /* Charge for enemy */
+    int eg = BAL(BAL_GAIN_ATK+et) - em[emove].cost;
+    e->charge += eg;
+    if(e->charge>MAX_CHARGE)e->charge=MAX_CHARGE;
+    if(e->charge<0)e->charge=0;
+    /* Buff tick */
+    if(e->buffActive && --e->buffTurns<=0) e->buffActive=0;
+}
+
+/* DoT ticks on enemies, scaled by player's ATK; player gets the kill reward */
+static void gauntletDots(Fighter *enemies, Fighter *player, BattleLog *log) {
     for(int i=0;i<3;i++){
-        Fighter *e=&gs->enemies[i];
+        Fighter *e=&enemies[i];
         if(e->hp>0 && e->dotStacks>0 && e->dotTurns>0){
-            int tick=calcDotTick(DOT_BASE[e->dotStacks-1],eAtk(player),eDef(e));
+            int tick=calcDotTick(BAL(BAL_DOT_1+e->dotStacks-1),eAtk(player),eDef(e));
             e->hp-=tick; e->dotTurns--;
-            snprintf(buf,128,"DoT: %s takes %d",e->name,tick); logAdd(&gs->log,buf);
+            LOGF(log, "DoT: %s takes %d",e->name,tick);
             if(e->dotTurns==0){ e->dotStacks=0;
-                snprintf(buf,128,"%s DoT faded",e->name); logAdd(&gs->log,buf);}
+                LOGF(log, "%s DoT faded",e->name);}
             if(e->hp<=0 && e->dotStacks>=0){
-                snprintf(buf,128,"%s defeated by DoT! +%d HP",e->name,GAUNTLET_HEAL_REWARD);
-                logAdd(&gs->log,buf);
+                LOGF(log, "%s defeated by DoT! +%d HP",e->name,GAUNTLET_HEAL_REWARD);
                 player->hp+=GAUNTLET_HEAL_REWARD;
                 if(player->hp>player->maxHp) player->hp=player->maxHp;
                 e->dotStacks=0;
@@ -873,122 +1840,3973 @@ void resolveGauntletTurn(GameState *gs) {
     }
 }
 
+/* One gauntlet turn: player plays move on enemies[tgt], then the living
+ * enemies act. log may be NULL. */
+void gauntletTurn(Fighter *player, Fighter *enemies, int move, int tgt, BattleLog *log) {
+    gauntletAct(player, enemies, move, tgt, NULL, log);
+
+    /* ---- ENEMIES ACT ---- */
+    LOGF(log, "--- ENEMIES TURN ---");
+    int playerDefending = (getMoves(player->classId)[move].type == MOVE_DEF);
+    for (int i=0;i<3;i++)
+        if (enemies[i].hp > 0) gauntletEnemy(&enemies[i], player, playerDefending, NULL, log);
+
+    gauntletDots(enemies, player, log);
+}
+
+/*
+ * CO-OP: two champions (p1, p2) each pick a move and a target, then act in
+ * seat order; a fallen champion skips its move. Each enemy goes for the
+ * champion that targeted it this turn, or by slot parity when both or
+ * neither did, so aggro is a pure function of the two commands and the
+ * turn stays a single O(enemies) pass with the same chance points as solo.
+ * DoTs tick off the stronger living champion, who also gets the kill HP.
+ * Each champion starts with COOP_HP_PCT% of the enemies' total HP.
+ */
+#define COOP_HP_PCT 90
+
+void coopStart(GameState *gs, int mode, int seat) {
+    int totalEnemyHp = gs->enemies[0].maxHp + gs->enemies[1].maxHp + gs->enemies[2].maxHp;
+    gs->p1.hp = gs->p1.maxHp = totalEnemyHp * COOP_HP_PCT / 100;
+    gs->p2.hp = gs->p2.maxHp = totalEnemyHp * COOP_HP_PCT / 100;
+    gs->coop = mode;
+    gs->seat = seat;
+    gs->selectedMove2 = gs->selectedTarget2 = gs->gauntletMove2 = 0;
+    gs->locked = 0;
+    gs->peerTurn = 0;
+}
+
+void coopTurn(Fighter *champ[2], Fighter *enemies, const int move[2], const int tgt[2], BattleLog *log) {
+    int defending[2] = {0, 0};
+    for (int s=0;s<2;s++) {
+        if (champ[s]->hp <= 0) continue;
+        gauntletAct(champ[s], enemies, move[s], tgt[s], champ[s]->name, log);
+        defending[s] = getMoves(champ[s]->classId)[move[s]].type == MOVE_DEF;
+    }
+
+    LOGF(log, "--- ENEMIES TURN ---");
+    for (int i=0;i<3;i++) {
+        if (enemies[i].hp <= 0) continue;
+        int s = (tgt[0]==i) != (tgt[1]==i) ? tgt[1]==i : i&1;
+        if (champ[s]->hp <= 0) s ^= 1;
+        if (champ[s]->hp <= 0) return;   /* both down: nothing left to hit */
+        gauntletEnemy(&enemies[i], champ[s], defending[s], champ[s]->name, log);
+    }
+
+    Fighter *owner = champ[0]->hp <= 0 ? champ[1] : champ[1]->hp <= 0 ? champ[0]
+                   : eAtk(champ[1]) > eAtk(champ[0]) ? champ[1] : champ[0];
+    if (owner->hp > 0) gauntletDots(enemies, owner, log);
+}
+
+/* Resolve one gauntlet turn */
+void resolveGauntletTurn(GameState *gs) {
+    if (gs->coop) {
+        Fighter *champ[2] = { &gs->p1, &gs->p2 };
+        int move[2] = { gs->gauntletMove, gs->gauntletMove2 };
+        int tgt[2]  = { gs->selectedTarget, gs->selectedTarget2 };
+        coopTurn(champ, gs->enemies, move, tgt, &gs->log);
+    } else {
+        gauntletTurn(&gs->p1, gs->enemies, gs->gauntletMove, gs->selectedTarget, &gs->log);
+    }
+}
+
 /* ===================== GAUNTLET DRAW ===================== */
 
-void drawGauntletBattle(GameState *gs) {
+/* Champion bars + turn counter: one centred bar, or in co-op both duel bars */
+void drawGauntletChampions(GameState *gs) {
+    const Layout *L = &gLayout;
     Fighter *p = &gs->p1;
+    if (gs->coop) {
+        Fighter *p2 = &gs->p2;
+        drawHPBar(L->hp[0].x, L->hp[0].y, L->hp[0].width, L->hp[0].height, p->hp, p->maxHp, &gHud.hp[HUD_P1]);
+        drawHPBarRTL(L->hp[1].x, L->hp[1].y, L->hp[1].width, L->hp[1].height, p2->hp, p2->maxHp, &gHud.hp[HUD_P2]);
+        drawChargePips(L->pips[0].x, L->pips[0].y, p->charge, 0);
+        drawChargePips(L->pips[1].x, L->pips[1].y, p2->charge, 1);
+    } else {
+        drawHPBar(L->gHp.x, L->gHp.y, L->gHp.width, L->gHp.height, p->hp, p->maxHp, &gHud.hp[HUD_P1]);
+        drawChargePips(L->gPips.x, L->gPips.y, p->charge, 0);
+    }
+    FDrawText(gHud.turn.s, L->cx-gHud.turn.w/2, L->gTurnY, 18, (Color){200,160,60,255});
+}
+
+/* Co-op move menus, one under each side; a networked partner's is hidden */
+static void drawCoopMenus(GameState *gs) {
+    const Layout *L = &gLayout;
+    for (int s=0;s<2;s++) {
+        Fighter *c = s ? &gs->p2 : &gs->p1;
+        int x = (int)L->coopMenu[s].x;
+        const char *hdr = gHud.header[s].s;
+        if (c->hp <= 0)                       hdr = "Fallen";
+        else if (gs->coop == 2 && s != gs->seat)
+            hdr = gs->peerTurn == gs->turn ? "Partner is ready" : "Partner is choosing...";
+        else if (gs->locked >> s & 1)         hdr = "Locked in - waiting...";
+        FDrawText(hdr, x, L->coopHdrY, 18, WHITE);
+        if (c->hp > 0 && (gs->coop == 1 || s == gs->seat))
+            drawMoveMenu(c, s ? gs->selectedMove2 : gs->selectedMove, x, (int)L->coopMenu[s].y, L->menuW);
+    }
+}
 
-    /* Player HP bar - full width at top */
-    int barW=600;
-    drawHPBar(SW/2-barW/2, 12, barW, 26, p->hp, p->maxHp, p->name);
-    drawChargePips(SW/2-115, 52, p->charge, 0);
+void drawGauntletBattle(GameState *gs) {
+    const Layout *L = &gLayout;
+    Fighter *p = &gs->p1;
 
-    char turnTxt[32];
-    snprintf(turnTxt,32,"GAUNTLET - Turn %d/%d", gs->turn, MAX_TURNS);
-    int tw=FMeasureText(turnTxt,18);
-    FDrawText(turnTxt, SW/2-tw/2, 76, 18, (Color){200,160,60,255});
+    /* Champion HP bar(s) at top */
+    drawGauntletChampions(gs);
 
     /* Three enemies across the top third, each with mini HP bar */
-    int eX[3] = {160, SW/2, SW-160};
-    int eY = 100;
+    int eY = L->enemyY, mbW = L->miniBarW;
     for (int i=0;i<3;i++) {
         Fighter *e = &gs->enemies[i];
-        int dead = (e->hp<=0);
+        int dead = (e->hp<=0), ex = L->enemyX[i];
 
-        /* Target highlight ring */
-        if (!dead && gs->selectedTarget==i) {
+        /* Target highlight ring; co-op: champion 2's is cyan, inset */
+        for (int s=0; s<(gs->coop?2:1) && !dead; s++) {
+            if ((s ? gs->selectedTarget2 : gs->selectedTarget) != i) continue;
+            if (gs->coop == 2 && s != gs->seat) continue;
             int sprW=(int)(gSprites[1][e->classId].width*SPRITE_SCALE);
             int sprH=(int)(gSprites[1][e->classId].height*SPRITE_SCALE);
-            DrawRectangleLines(eX[i]-sprW/2-4, eY-4, sprW+8, sprH+8, (Color){255,220,50,255});
+            uiRectLines(ex-sprW/2-4+s*4, eY-4+s*4, sprW+8-s*8, sprH+8-s*8,
+                        s ? (Color){80,220,255,255} : (Color){255,220,50,255});
         }
 
-        drawSprite(1, e->classId, eX[i], eY, dead);
+        drawSprite(1, e->classId, ex, eY, dead);
 
         /* Mini HP bar under each enemy */
-        int mbW=140;
         if (!dead) {
             float r=(float)e->hp/(float)e->maxHp;
             Color fill=GREEN; if(r<0.5f)fill=YELLOW; if(r<0.25f)fill=RED;
-            DrawRectangle(eX[i]-mbW/2, eY+220, mbW, 12, (Color){40,40,40,255});
-            DrawRectangle(eX[i]-mbW/2, eY+220, (int)(mbW*r), 12, fill);
-            DrawRectangleLines(eX[i]-mbW/2, eY+220, mbW, 12, (Color){150,150,150,255});
-            char hpTxt[32]; snprintf(hpTxt,32,"%s %d/%d",e->name,e->hp,e->maxHp);
-            int ht=FMeasureText(hpTxt,13);
-            FDrawText(hpTxt, eX[i]-ht/2, eY+235, 13, WHITE);
+            uiRect(ex-mbW/2, L->miniBarY, mbW, 12, (Color){40,40,40,255});
+            uiRect(ex-mbW/2, L->miniBarY, (int)(mbW*r), 12, fill);
+            uiRectLines(ex-mbW/2, L->miniBarY, mbW, 12, (Color){150,150,150,255});
+            const HudText *ht=&gHud.hp[HUD_ENEMY0+i];
+            FDrawText(ht->s, ex-ht->w/2, L->miniLabelY, 13, WHITE);
             /* charge pips mini */
             for(int p2=0;p2<MAX_CHARGE;p2++){
-                int px=eX[i]-mbW/2+p2*14;
-                DrawRectangle(px,eY+252,11,7,p2<e->charge?(Color){255,200,30,255}:(Color){40,40,40,255});
+                int px=ex-mbW/2+p2*14;
+                uiRect(px,L->miniPipsY,11,7,p2<e->charge?(Color){255,200,30,255}:(Color){40,40,40,255});
             }
-            drawStatusTags(eX[i]-70, eY+264, e);
+            drawStatusTags(ex-70, L->miniTagsY, e, HUD_ENEMY0+i);
         } else {
             int dw=FMeasureText("DEFEATED",16);
-            FDrawText("DEFEATED", eX[i]-dw/2, eY+220, 16, (Color){150,50,50,255});
+            FDrawText("DEFEATED", ex-dw/2, L->miniBarY, 16, (Color){150,50,50,255});
         }
     }
 
     /* Target selection hint */
-    FDrawText("< > to select target", SW/2-FMeasureText("< > to select target",16)/2, 300, 16, (Color){140,140,140,255});
+    const char *hint = gs->coop == 1 ? "Champion 1: W/S A/D SPACE     Champion 2: arrows ENTER" : "< > to select target";
+    FDrawText(hint, L->cx-FMeasureText(hint,16)/2, L->targetHintY, 16, (Color){140,140,140,255});
 
-    /* Move menu centered at bottom */
-    drawMoveMenu(p, gs->selectedMove, SW/2-280, 330, 560);
+    /* Move menu centered at bottom, co-op: one per side */
+    if (gs->coop) drawCoopMenus(gs);
+    else          drawMoveMenu(p, gs->selectedMove, L->gMenu.x, L->gMenu.y, L->menuW);
 }
 
 void drawGauntletResolve(GameState *gs) {
-    Fighter *p = &gs->p1;
-
-    /* Player HP bar */
-    int barW=600;
-    drawHPBar(SW/2-barW/2, 12, barW, 26, p->hp, p->maxHp, p->name);
-    drawChargePips(SW/2-115, 52, p->charge, 0);
+    const Layout *L = &gLayout;
 
-    char turnTxt[32];
-    snprintf(turnTxt,32,"GAUNTLET - Turn %d/%d", gs->turn, MAX_TURNS);
-    int tw=FMeasureText(turnTxt,18);
-    FDrawText(turnTxt, SW/2-tw/2, 76, 18, (Color){200,160,60,255});
+    /* Champion HP bar(s) */
+    drawGauntletChampions(gs);
 
     /* Enemies */
-    int eX[3]={160,SW/2,SW-160}, eY=100;
+    int eY=L->enemyY, mbW=L->miniBarW;
     for(int i=0;i<3;i++){
         Fighter *e=&gs->enemies[i];
-        int dead=(e->hp<=0);
-        drawSprite(1,e->classId,eX[i],eY,dead);
-        int mbW=140;
+        int dead=(e->hp<=0), ex=L->enemyX[i];
+        drawSprite(1,e->classId,ex,eY,dead);
         if(!dead){
             float r=(float)e->hp/(float)e->maxHp;
             Color fill=GREEN; if(r<0.5f)fill=YELLOW; if(r<0.25f)fill=RED;
-            DrawRectangle(eX[i]-mbW/2,eY+220,mbW,12,(Color){40,40,40,255});
-            DrawRectangle(eX[i]-mbW/2,eY+220,(int)(mbW*r),12,fill);
-            DrawRectangleLines(eX[i]-mbW/2,eY+220,mbW,12,(Color){150,150,150,255});
-            char hpTxt[32]; snprintf(hpTxt,32,"%s %d/%d",e->name,e->hp,e->maxHp);
-            int ht=FMeasureText(hpTxt,13);
-            FDrawText(hpTxt,eX[i]-ht/2,eY+235,13,WHITE);
+            uiRect(ex-mbW/2,L->miniBarY,mbW,12,(Color){40,40,40,255});
+            uiRect(ex-mbW/2,L->miniBarY,(int)(mbW*r),12,fill);
+            uiRectLines(ex-mbW/2,L->miniBarY,mbW,12,(Color){150,150,150,255});
+            const HudText *ht=&gHud.hp[HUD_ENEMY0+i];
+            FDrawText(ht->s,ex-ht->w/2,L->miniLabelY,13,WHITE);
         } else {
             int dw=FMeasureText("DEFEATED",16);
-            FDrawText("DEFEATED",eX[i]-dw/2,eY+220,16,(Color){150,50,50,255});
+            FDrawText("DEFEATED",ex-dw/2,L->miniBarY,16,(Color){150,50,50,255});
         }
     }
 
     /* Battle log centered */
-    int logW=600, logH=MAX_LOG_LINES*21+16;
-    drawBattleLog(&gs->log, SW/2-logW/2, 330, logW, logH);
+    drawBattleLog(&gs->log, L->gLog.x, L->gLog.y, L->gLog.width, L->gLog.height);
 
-    FDrawText("Press ENTER to continue...", SW/2-FMeasureText("Press ENTER to continue...",18)/2, 680, 18, (Color){120,120,120,255});
+    FDrawText("Press ENTER to continue...", L->cx-FMeasureText("Press ENTER to continue...",18)/2, L->gPromptY, 18, (Color){120,120,120,255});
 }
 
-/* ===================== MAIN ===================== */
-
-int main(void) {
-    srand((unsigned)time(NULL));
+/* ===================== DASHBOARD ===================== */
+/*
+ * Typing DASHBOARD on the menu opens a balance dashboard over the columnar
+ * output of --sim-export DIR (read from DASH_DIR). One file per column, raw
+ * little-endian, row count = file size / width:
+ *   game_matchup.u8  P1 class*3 + P2 class    turn_game.u32  row's game
+ *   game_result.u8   0 loss 1 draw 2 win      turn_hp.i16    HP after the turn, P1 P2 pairs
+ *   game_turns.u8    turns played             turn_dmg.i16   HP lost in the turn, P1 P2 pairs
+ * A game's first hp + dmg is its starting HP, so HP% follows the balance the
+ * games were played under rather than the one running now.
+ * A loader thread streams the turn columns in chunks into fixed bins
+ * (matchup scores, HP% per turn per class, HP lost per turn - hits and DoT
+ * together - per class), so a frame only ever draws the bins - a few
+ * hundred quads through the UI batch, the same cost for a thousand rows or
+ * fifty million. Each visit to the screen loads the export afresh.
+ */
+#define DASH_DIR       "tbc_sim"
+#define DASH_HP_BINS   20    /* 5% each */
+#define DASH_DMG_BINS  48    /* 1 HP each, the last one open */
+#define DASH_CHUNK     65536
+
+enum { DASH_IDLE, DASH_LOADING, DASH_READY, DASH_MISSING };
+
+typedef struct {
+    atomic_int state;
+    char       why[128];                                   /* DASH_MISSING */
+    uint64_t   games, rows, loadNs;
+    double     score[9], played[9], turns[9];              /* by matchup */
+    uint32_t   hp[3][MAX_TURNS+1][DASH_HP_BINS];           /* by class, turn, HP% */
+    uint32_t   hpPeak[3];                                  /* densest bin per class, for shading */
+    uint64_t   dmg[3][DASH_DMG_BINS];                      /* opponent's HP lost per turn, by class */
+    uint64_t   dmgPeak[3];
+    int        labelled;                                   /* main thread: labels below built */
+    HudText    cell[9], summary, dmgAxis[3];
+} Dash;
+
+static Dash gDash;
+
+static const char *DASH_COLUMN[6] = {
+    "game_matchup.u8", "game_result.u8", "game_turns.u8", "turn_game.u32", "turn_hp.i16", "turn_dmg.i16",
+};
+
+/* --sim-export DIR [--sim-games N]: AI-vs-AI duels over every matchup */
+int simExportMain(const char *dir, int games) {
+    FILE *f[6];
+    char path[512];
+    for (int c=0;c<6;c++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, DASH_COLUMN[c]);
+        if (!(f[c] = fopen(path, "wb"))) {
+            fprintf(stderr, "%s: cannot write (does %s exist?)\n", path, dir);
+            while (c--) fclose(f[c]);
+            return 1;
+        }
+    }
+    /* A batch of games at a time; rows are kept so each game's stay together */
+    static DuelBatch d;
+    static int16_t hp[DUEL_BATCH][MAX_TURNS][2], dmg[DUEL_BATCH][MAX_TURNS][2];
+    const AiPolicy *p = aiActive();
+    uint64_t t0 = nowNs(), rows = 0;
+    for (uint32_t at=0; at<(uint32_t)games; at+=DUEL_BATCH) {
+        d.n = d.running = 0;
+        for (uint32_t g=at; g<(uint32_t)games && g<at+DUEL_BATCH; g++) duelBatchAdd(&d, g%9/3, g%3, 0x9E3779B9u * (g+1));
+        for (int t=0, live=d.n; live; t++) {
+            live = duelBatchTick(&d, p);
+            for (int i=0;i<d.n;i++) {
+                if (d.turns[i] != t+1) continue;   /* was already over */
+                int ha = t ? hp[i][t-1][0] : d.a[i].maxHp, hb = t ? hp[i][t-1][1] : d.b[i].maxHp;
+                hp[i][t][0]  = (int16_t)d.a[i].hp;        hp[i][t][1]  = (int16_t)d.b[i].hp;
+                dmg[i][t][0] = (int16_t)(ha - d.a[i].hp); dmg[i][t][1] = (int16_t)(hb - d.b[i].hp);
+            }
+        }
+        for (int i=0;i<d.n;i++) {
+            uint32_t g = at + i, gs[MAX_TURNS];
+            uint8_t m = (uint8_t)(g % 9), res = (uint8_t)(duelBatchScore(&d, i) * 2), turns = d.turns[i];
+            for (int t=0;t<turns;t++) gs[t] = g;
+            fwrite(gs, 4, turns, f[3]); fwrite(hp[i], 4, turns, f[4]); fwrite(dmg[i], 4, turns, f[5]);
+            fwrite(&m, 1, 1, f[0]); fwrite(&res, 1, 1, f[1]); fwrite(&turns, 1, 1, f[2]);
+            rows += turns;
+        }
+    }
+    int err = 0;
+    for (int c=0;c<6;c++) err |= ferror(f[c]) | fclose(f[c]);
+    if (err) { fprintf(stderr, "%s: write failed\n", dir); return 1; }
+    printf("%s: %d games, %llu turn rows in %.1fs\n", dir, games, (unsigned long long)rows, (nowNs()-t0)*1e-9);
+    return 0;
+}
+
+static long dashSize(FILE *f) {
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    return n;
+}
+
+static void dashFail(Dash *D, const char *why, FILE **f, uint8_t *keep) {
+    snprintf(D->why, sizeof(D->why), "%s", why);
+    for (int c=0;c<6;c++) if (f[c]) fclose(f[c]);
+    free(keep);
+    atomic_store(&D->state, DASH_MISSING);
+}
+
+static void *dashLoad(void *arg) {
+    Dash *D = arg;
+    uint64_t t0 = nowNs();
+    FILE *f[6] = {0};
+    char path[64], why[128];
+    for (int c=0;c<6;c++) {
+        snprintf(path, sizeof(path), DASH_DIR "/%s", DASH_COLUMN[c]);
+        if (!(f[c] = fopen(path, "rb"))) {
+            snprintf(why, sizeof(why), "no %s - run --sim-export " DASH_DIR, path);
+            dashFail(D, why, f, NULL);
+            return NULL;
+        }
+    }
+    long games = dashSize(f[0]), rows = dashSize(f[3]) / 4;
+    if (!games || dashSize(f[1]) != games || dashSize(f[2]) != games
+        || dashSize(f[4]) != rows*4 || dashSize(f[5]) != rows*4) {
+        dashFail(D, "columns in " DASH_DIR " don't line up - export again", f, NULL);
+        return NULL;
+    }
+
+    /* Per-game columns stay in memory (3 bytes a game); turn rows stream */
+    uint8_t *gm = malloc((size_t)games * 3), *gr = gm + games, *gt = gr + games;
+    if (!gm || fread(gm, 1, (size_t)games, f[0]) != (size_t)games || fread(gr, 1, (size_t)games, f[1]) != (size_t)games
+        || fread(gt, 1, (size_t)games, f[2]) != (size_t)games) {
+        dashFail(D, "cannot read the game columns", f, gm);
+        return NULL;
+    }
+    for (long g=0; g<games; g++) {
+        if (gm[g] >= 9) { dashFail(D, "bad matchup in game_matchup.u8", f, gm); return NULL; }
+        D->played[gm[g]] += 1;
+        D->score[gm[g]]  += gr[g] * 0.5;
+        D->turns[gm[g]]  += gt[g];
+    }
+
+    static uint32_t game[DASH_CHUNK];
+    static int16_t  hp[DASH_CHUNK][2], dmg[DASH_CHUNK][2];
+    uint32_t lastGame = UINT32_MAX;
+    int turn = 0, maxHp[2] = {0, 0};   /* a game's rows are consecutive */
+    for (long done=0; done<rows; ) {
+        size_t n = rows - done < DASH_CHUNK ? (size_t)(rows - done) : DASH_CHUNK;
+        if (fread(game, 4, n, f[3]) != n || fread(hp, 4, n, f[4]) != n || fread(dmg, 4, n, f[5]) != n) {
+            dashFail(D, "cannot read the turn columns", f, gm);
+            return NULL;
+        }
+        for (size_t i=0;i<n;i++) {
+            if (game[i] >= (uint32_t)games) continue;
+            int m = gm[game[i]], cls[2] = { m/3, m%3 };
+            turn = game[i] == lastGame ? turn+1 : 1;
+            lastGame = game[i];
+            if (turn == 1) for (int s=0;s<2;s++) maxHp[s] = hp[i][s] + dmg[i][s];
+            for (int s=0;s<2;s++) {
+                int pct = hp[i][s] <= 0 || maxHp[s] <= 0 ? 0 : hp[i][s] * 100 / maxHp[s];
+                int bin = pct * DASH_HP_BINS / 100;
+                if (bin >= DASH_HP_BINS) bin = DASH_HP_BINS-1;
+                if (turn <= MAX_TURNS) D->hp[cls[s]][turn][bin]++;
+                int d = dmg[i][s];   /* lost by side s, dealt by the other */
+                if (d > 0) D->dmg[cls[!s]][d < DASH_DMG_BINS ? d : DASH_DMG_BINS-1]++;
+            }
+        }
+        done += (long)n;
+    }
+    for (int c=0;c<3;c++) {
+        for (int t=1;t<=MAX_TURNS;t++)
+            for (int b=0;b<DASH_HP_BINS;b++) if (D->hp[c][t][b] > D->hpPeak[c]) D->hpPeak[c] = D->hp[c][t][b];
+        for (int b=1;b<DASH_DMG_BINS;b++) if (D->dmg[c][b] > D->dmgPeak[c]) D->dmgPeak[c] = D->dmg[c][b];
+    }
+    D->games = (uint64_t)games; D->rows = (uint64_t)rows;
+    D->loadNs = nowNs() - t0;
+    for (int c=0;c<6;c++) fclose(f[c]);
+    free(gm);
+    atomic_store(&D->state, DASH_READY);
+    return NULL;
+}
+
+/* Drops a finished load so the next frame starts another; a running loader
+ * still owns the bins and is left alone. Draw thread only, like the bins' reader. */
+void dashReload(void) {
+    Dash *D = &gDash;
+    int state = atomic_load(&D->state);
+    if (state != DASH_READY && state != DASH_MISSING) return;
+    memset((char *)D + offsetof(Dash, why), 0, sizeof(*D) - offsetof(Dash, why));
+    atomic_store(&D->state, DASH_IDLE);
+}
+
+/* Score colour: P2 favoured (blue) .. even (grey) .. P1 favoured (red) */
+static Color dashHeat(double s) {
+    float t = (float)(s < 0 ? 0 : s > 1 ? 1 : s);
+    if (t < 0.5f) { float u = t*2;     return (Color){(unsigned char)(40+70*u), (unsigned char)(70+40*u), (unsigned char)(200-90*u), 255}; }
+    else          { float u = (t-.5f)*2; return (Color){(unsigned char)(110+110*u), (unsigned char)(110-60*u), (unsigned char)(110-70*u), 255}; }
+}
+
+void drawDashboard(int cls) {
+    static const char *names[3] = { "Knight", "Magician", "Alchemist" };
+    Dash *D = &gDash;
+    int cx = gLayout.cx, w = gLayout.w;
+    int state = atomic_load(&D->state);
+    if (state == DASH_IDLE) {
+        static pthread_t loader;
+        atomic_store(&D->state, state = DASH_LOADING);
+        pthread_create(&loader, NULL, dashLoad, D);
+        pthread_detach(loader);
+    }
+    FDrawText("BALANCE DASHBOARD", cx-FMeasureText("BALANCE DASHBOARD",32)/2, 20, 32, WHITE);
+    FDrawText("LEFT/RIGHT class   ENTER back", cx-FMeasureText("LEFT/RIGHT class   ENTER back",16)/2, 690, 16, (Color){120,120,120,255});
+    if (state == DASH_LOADING) { FDrawText("Loading " DASH_DIR "...", cx-90, 330, 22, (Color){200,200,200,255}); return; }
+    if (state == DASH_MISSING) { FDrawText(D->why, cx-FMeasureText(D->why,20)/2, 330, 20, (Color){220,120,80,255}); return; }
+
+    if (!D->labelled) {   /* once, on the main thread: hudText measures with the font */
+        for (int m=0;m<9;m++)
+            hudText(&D->cell[m], 18, "%.1f%%", D->played[m] ? D->score[m] / D->played[m] * 100 : 0);
+        hudText(&D->summary, 16, "%llu games, %llu turn rows, binned in %.0f ms",
+                (unsigned long long)D->games, (unsigned long long)D->rows, D->loadNs * 1e-6);
+        for (int c=0;c<3;c++) hudText(&D->dmgAxis[c], 14, "turns: %llu at peak", (unsigned long long)D->dmgPeak[c]);
+        D->labelled = 1;
+    }
+    FDrawText(D->summary.s, cx-D->summary.w/2, 60, 16, (Color){150,150,150,255});
+
+    /* Matchup heatmap: P1 score, rows P1 class, columns P2 class */
+    int hx = 40, hy = 130, cw = 110, ch = 70;
+    FDrawText("P1 score by matchup", hx, hy-40, 18, (Color){200,200,200,255});
+    for (int b=0;b<3;b++) FDrawText(names[b], hx+90+b*cw+8, hy-18, 14, (Color){160,160,160,255});
+    for (int a=0;a<3;a++) {
+        FDrawText(names[a], hx, hy+a*ch+ch/2-8, 14, a == cls ? (Color){255,220,50,255} : (Color){160,160,160,255});
+        for (int b=0;b<3;b++) {
+            int m = a*3+b, x = hx+90+b*cw, y = hy+a*ch;
+            uiRect(x, y, cw-4, ch-4, dashHeat(D->played[m] ? D->score[m] / D->played[m] : 0.5));
+            FDrawText(D->cell[m].s, x+(cw-4)/2-D->cell[m].w/2, y+ch/2-11, 18, WHITE);
+        }
+    }
+
+    /* HP% over turns for the chosen class: one shaded cell per (turn, 5% bin) */
+    int px = hx+90+3*cw+50, py = 100, pw = w - px - 40, ph = 260;
+    int colW = pw / MAX_TURNS, rowH = ph / DASH_HP_BINS;
+    FDrawText(names[cls], px, py-30, 18, (Color){255,220,50,255});
+    FDrawText("HP% over turns", px+FMeasureText(names[cls],18)+10, py-28, 16, (Color){200,200,200,255});
+    uiRect(px, py, colW*MAX_TURNS, rowH*DASH_HP_BINS, (Color){20,20,28,255});
+    double peak = D->hpPeak[cls] ? (double)D->hpPeak[cls] : 1;
+    for (int t=1;t<=MAX_TURNS;t++) {
+        const uint32_t *bin = D->hp[cls][t];
+        uint64_t n = 0, seen = 0;
+        for (int b=0;b<DASH_HP_BINS;b++) n += bin[b];
+        for (int b=0;b<DASH_HP_BINS;b++) {
+            if (!bin[b]) continue;
+            unsigned char a = (unsigned char)(40 + 215 * sqrt(bin[b] / peak));
+            uiRect(px+(t-1)*colW, py+(DASH_HP_BINS-1-b)*rowH, colW-1, rowH-1, (Color){80,200,120,a});
+        }
+        for (int b=0;b<DASH_HP_BINS && n;b++)   /* median tick */
+            if ((seen += bin[b]) * 2 >= n) { uiRect(px+(t-1)*colW, py+(DASH_HP_BINS-1-b)*rowH+rowH/2-1, colW-1, 3, (Color){255,220,50,255}); break; }
+    }
+    uiRectLines(px-1, py-1, colW*MAX_TURNS+2, rowH*DASH_HP_BINS+2, (Color){80,80,80,255});
+    FDrawText("100%", px-40, py-2, 12, (Color){120,120,120,255});
+    FDrawText("0%",   px-24, py+ph-14, 12, (Color){120,120,120,255});
+    FDrawText("turn 1", px, py+rowH*DASH_HP_BINS+6, 12, (Color){120,120,120,255});
+
+    /* HP the chosen class's opponent lost per turn, DoT included */
+    int dx = px, dy = 440, dh = 190, bw = pw / DASH_DMG_BINS;
+    FDrawText("HP lost per turn", dx, dy-28, 16, (Color){200,200,200,255});
+    FDrawText(D->dmgAxis[cls].s, dx+pw-D->dmgAxis[cls].w, dy-26, 14, (Color){120,120,120,255});
+    double dpeak = D->dmgPeak[cls] ? (double)D->dmgPeak[cls] : 1;
+    for (int b=1;b<DASH_DMG_BINS;b++) {
+        int h = (int)(dh * (D->dmg[cls][b] / dpeak));
+        if (h > dh) h = dh;
+        uiRect(dx+b*bw, dy+dh-h, bw-1, h, b == DASH_DMG_BINS-1 ? (Color){220,120,60,255} : (Color){200,80,80,255});
+    }
+    uiRect(dx, dy+dh, bw*DASH_DMG_BINS, 1, (Color){80,80,80,255});
+    FDrawText("1", dx+bw, dy+dh+4, 12, (Color){120,120,120,255});
+    FDrawText("47+", dx+(DASH_DMG_BINS-1)*bw-6, dy+dh+4, 12, (Color){120,120,120,255});
+}
+
+/* ===================== RENDER SCALING ===================== */
+/*
+ * Screens are laid out on the logical canvas from gLayout, but drawn into an
+ * offscreen target of (w x h)*scale (a Camera2D zoom does the mapping) and
+ * then blitted, letterboxed, to whatever size the window really is.
+ * A 4K fullscreen kiosk therefore only shades the internal resolution.
+ *
+ * With dynamic resolution on, a smoothed frame time over budget for
+ * DYNRES_DROP_FRAMES frames steps the scale down; a long run on budget probes
+ * one step back up (and simply drops again if the GPU can't keep up).
+ */
+#define TARGET_FPS         60
+#define DYNRES_STEP        0.125f
+#define DYNRES_MIN         0.5f
+#define DYNRES_DROP_FRAMES 30
+#define DYNRES_RAISE_FRAMES 600
+
+typedef struct {
+    RenderTexture2D target;
+    float scale;        /* current internal scale */
+    float maxScale;     /* configured internal scale */
+    int   dynamic;
+    float frameAvg;
+    int   overBudget, onBudget;
+} RenderScaler;
+
+void scalerResize(RenderScaler *rs, float scale) {
+    if (rs->target.id != 0) UnloadRenderTexture(rs->target);
+    rs->scale  = scale;
+    rs->target = LoadRenderTexture((int)(gLayout.w*scale), (int)(gLayout.h*scale));
+    SetTextureFilter(rs->target.texture, TEXTURE_FILTER_BILINEAR);
+    rs->overBudget = rs->onBudget = 0;
+}
+
+void scalerInit(RenderScaler *rs, float scale, int dynamic) {
+    memset(rs, 0, sizeof(*rs));
+    if (scale < 0.25f) scale = 0.25f;
+    if (scale > 3.0f)  scale = 3.0f;
+    rs->maxScale = scale;
+    rs->dynamic  = dynamic;
+    rs->frameAvg = 1.0f/TARGET_FPS;
+    scalerResize(rs, scale);
+}
+
+void scalerBegin(RenderScaler *rs) {
+    BeginTextureMode(rs->target);
+    ClearBackground(BLACK);
+    BeginMode2D((Camera2D){ .zoom = rs->scale });
+}
+
+void scalerEnd(RenderScaler *rs) {
+    uiFlush();
+    EndMode2D();
+    EndTextureMode();
+
+    /* Fit the canvas into the window, bars on the long side if it's clamped */
+    float cw=(float)gLayout.w, ch=(float)gLayout.h;
+    float ww=(float)GetScreenWidth(), wh=(float)GetScreenHeight();
+    float k = (ww/cw < wh/ch) ? ww/cw : wh/ch;
+    Rectangle src = {0, 0, (float)rs->target.texture.width, -(float)rs->target.texture.height};
+    Rectangle dst = {(ww-cw*k)/2, (wh-ch*k)/2, cw*k, ch*k};
+
+    BeginDrawing();
+    ClearBackground(BLACK);
+    DrawTexturePro(rs->target.texture, src, dst, (Vector2){0,0}, 0.0f, WHITE);
+    EndDrawing();
+}
+
+/* Feed the last frame time; resizes the target when the scale changes */
+void scalerUpdate(RenderScaler *rs, float frameTime) {
+    if (!rs->dynamic) return;
+    const float budget = 1.0f/TARGET_FPS;
+    rs->frameAvg += (frameTime - rs->frameAvg) * 0.1f;
+
+    if (rs->frameAvg > budget*1.10f) { rs->overBudget++; rs->onBudget=0; }
+    else                             { rs->onBudget++;   rs->overBudget=0; }
+
+    if (rs->overBudget >= DYNRES_DROP_FRAMES && rs->scale - DYNRES_STEP >= DYNRES_MIN - 0.001f) {
+        scalerResize(rs, rs->scale - DYNRES_STEP);
+        rs->frameAvg = budget;
+    } else if (rs->onBudget >= DYNRES_RAISE_FRAMES && rs->scale + DYNRES_STEP <= rs->maxScale + 0.001f) {
+        scalerResize(rs, rs->scale + DYNRES_STEP);
+    }
+}
+
+/* ===================== BALANCE PATCHES ===================== */
+/*
+ * --balance-patch PATH watches a file of NAME=VALUE lines (BAL_NAME, over
+ * BALANCE_DEFAULT) and publishes each good edit as a new Balance version
+ * without disturbing the match in progress: read-copy-update. A version is
+ * immutable once published; a match pins the version that was live when it
+ * started and plays to the end on it; a retired version is freed when its
+ * last pin goes. Threads read the numbers through gBal as before - a pin
+ * only decides which numbers gBal points at.
+ */
+#define BAL_PATCH_MAX_BYTES 8192
+
+typedef struct BalVersion {
+    const Balance     *bal;
+    uint32_t           id;       /* 1 is BALANCE_DEFAULT */
+    atomic_int         refs;     /* pins */
+    struct BalVersion *next;     /* retired list */
+    Balance            own;      /* bal, for published versions */
+} BalVersion;
+
+static BalVersion            gBalFirst = { .bal = &BALANCE_DEFAULT, .id = 1 };
+static _Atomic(BalVersion *) gBalLive  = &gBalFirst;
+static atomic_int            gBalPinning;   /* pins between reading gBalLive and counting themselves */
+static pthread_mutex_t       gBalRetireLock = PTHREAD_MUTEX_INITIALIZER;
+static BalVersion           *gBalRetired;
+
+BalVersion *balPin(void) {
+    atomic_fetch_add(&gBalPinning, 1);
+    BalVersion *v = atomic_load(&gBalLive);
+    atomic_fetch_add(&v->refs, 1);
+    atomic_fetch_sub(&gBalPinning, 1);
+    return v;
+}
+
+/* Frees retired versions nobody pins. A pin still between its read of
+ * gBalLive and its count could be holding any of them, so while one is in
+ * flight nothing goes; the next unpin or publish gets them. */
+static void balReclaim(void) {
+    pthread_mutex_lock(&gBalRetireLock);
+    if (!atomic_load(&gBalPinning))
+        for (BalVersion **p = &gBalRetired; *p; ) {
+            BalVersion *v = *p;
+            if (atomic_load(&v->refs)) { p = &v->next; continue; }
+            *p = v->next;
+            if (v != &gBalFirst) free(v);
+        }
+    pthread_mutex_unlock(&gBalRetireLock);
+}
+
+void balUnpin(BalVersion *v) {
+    if (v && atomic_fetch_sub(&v->refs, 1) == 1 && v != atomic_load(&gBalLive)) balReclaim();
+}
+
+/* Moves *pin to the live version; returns 1 if that was a change */
+int balRepin(BalVersion **pin) {
+    if (*pin == atomic_load(&gBalLive)) return 0;
+    BalVersion *old = *pin;
+    *pin = balPin();
+    balUnpin(old);
+    return 1;
+}
+
+/* Makes a copy of b the live version for matches that start from now on;
+ * returns its id, 0 when out of memory */
+uint32_t balPublish(const Balance *b) {
+    BalVersion *v = calloc(1, sizeof(*v));
+    if (!v) return 0;
+    v->own = *b;
+    v->bal = &v->own;
+    pthread_mutex_lock(&gBalRetireLock);   /* also keeps publishers in line */
+    BalVersion *old = atomic_load(&gBalLive);
+    v->id = old->id + 1;
+    atomic_store(&gBalLive, v);
+    old->next = gBalRetired;
+    gBalRetired = old;
+    pthread_mutex_unlock(&gBalRetireLock);
+    balReclaim();
+    return v->id;
+}
+
+int balFind(const char *name) {
+    for (int id=0;id<BAL_COUNT;id++) if (!strcmp(name, BAL_NAME[id])) return id;
+    return -1;
+}
+
+/* NAME=VALUE lines over BALANCE_DEFAULT; # starts a comment */
+static int balParse(const char *src, Balance *out, char *why, size_t n) {
+    *out = BALANCE_DEFAULT;
+    char line[128], name[64];
+    int v, lineNo = 0;
+    for (const char *p = src; *p; ) {
+        size_t len = strcspn(p, "\n"), k = len < sizeof(line)-1 ? len : sizeof(line)-1;
+        memcpy(line, p, k); line[k] = '\0';
+        p += len + (p[len] == '\n');
+        lineNo++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        if (!line[strspn(line, " \t\r")]) continue;
+        int id = -1;
+        if (sscanf(line, " %63[^= \t] = %d", name, &v) != 2 || (id = balFind(name)) < 0) {
+            snprintf(why, n, "line %d: want NAME=VALUE with a BAL_NAME", lineNo);
+            return 0;
+        }
+        const char *bad = balRange(id, v);
+        if (bad) {
+            snprintf(why, n, "line %d: %s: %s", lineNo, name, bad);
+            return 0;
+        }
+        out->v[id] = v;
+    }
+    return 1;
+}
+
+typedef struct {
+    const char *path;        /* NULL: no patches */
+    time_t      seenMtime, pendingMtime;   /* settles like HotEngine */
+    off_t       seenSize, pendingSize;
+} BalPatch;
+
+static BalPatch gBalPatch;
+
+/* Publishes the patch file if it changed and has stopped changing. A bad
+ * or missing file leaves the live version alone. Returns 1 when gs was
+ * touched (a note in its log). */
+int balPoll(BalPatch *bp, GameState *gs) {
+    struct stat st;
+    if (!bp->path || stat(bp->path, &st) != 0) return 0;
+    if (st.st_mtime == bp->seenMtime && st.st_size == bp->seenSize) return 0;
+    if (st.st_mtime != bp->pendingMtime || st.st_size != bp->pendingSize) {
+        bp->pendingMtime = st.st_mtime;
+        bp->pendingSize  = st.st_size;
+        return 0;
+    }
+    bp->seenMtime = st.st_mtime;
+    bp->seenSize  = st.st_size;
+
+    char src[BAL_PATCH_MAX_BYTES+1], why[160], msg[128];
+    Balance b;
+    FILE *f = fopen(bp->path, "rb");
+    size_t got = f ? fread(src, 1, BAL_PATCH_MAX_BYTES + 1, f) : 0;
+    if (f) fclose(f);
+    src[got < BAL_PATCH_MAX_BYTES ? got : BAL_PATCH_MAX_BYTES] = '\0';
+    uint32_t id = 0;
+    if (!f)                             snprintf(why, sizeof(why), "cannot read");
+    else if (got > BAL_PATCH_MAX_BYTES) snprintf(why, sizeof(why), "over %d bytes", BAL_PATCH_MAX_BYTES);
+    else if (balParse(src, &b, why, sizeof(why)) && !(id = balPublish(&b))) snprintf(why, sizeof(why), "out of memory");
+    if (id) snprintf(msg, sizeof(msg), "Balance v%u live from the next match", id);
+    else {
+        fprintf(stderr, "balance patch %s: %s\n", bp->path, why);
+        snprintf(msg, sizeof(msg), "Balance patch rejected - kept v%u", atomic_load(&gBalLive)->id);
+    }
+    if (gs) { logAdd(&gs->log, msg); stateChanged(gs); }
+    return gs != NULL;
+}
+
+/* ===================== ENGINE (HOT RELOAD) ===================== */
+/*
+ * Turn resolution and the AI sit behind an EngineApi. The game links its own
+ * copy (gBuiltinEngine); --engine PATH instead loads the same source built as
+ * a shared library and reloads it whenever the file changes, so a rule tweak
+ * in resolveTurn is a rebuild of the .so while the match stays on screen:
+ *
+ *   gcc -DTBC_ENGINE_SO -shared -fPIC -fvisibility=hidden trial_by_combat_raylib.c \
+ *       -lraylib -lm -lpthread -o tbc_engine.so
+ *
+ * The engine keeps no state of its own: the match lives in the client's
+ * GameState and the RNG word is passed in and out, so a reload carries on
+ * mid-match. A library built against a different GameState layout is refused.
+ */
+#define ENGINE_ABI 5   /* bump with any Fighter/GameState/AiPolicy layout change */
+
+typedef struct {
+    uint32_t abi, stateSize;
+    void (*turn)(GameState *gs, uint32_t *rng, const AiPolicy *ai);
+    int  (*chooseMove)(Fighter *ai, Fighter *opp, uint32_t *rng, const AiPolicy *policy);
+} EngineApi;
+
+static void engineTurn(GameState *gs, uint32_t *rng, const AiPolicy *ai) {
+    gRng = *rng;
+    if (gAi != ai) gAi = ai;   /* only a library image needs the store; games may run side by side */
+    gBal = gs->bal ? gs->bal->bal : &BALANCE_DEFAULT;   /* never a previous match's */
+    if (gs->gauntletMode) resolveGauntletTurn(gs);
+    else                  resolveTurn(&gs->p1,&gs->p2,gs->moveP1,gs->moveP2,&gs->log);
+    *rng = gRng;
+}
+
+static int engineChooseMove(Fighter *ai, Fighter *opp, uint32_t *rng, const AiPolicy *policy) {
+    gRng = *rng;
+    gAi  = policy;
+    int m = chooseMoveAI(ai, opp);
+    *rng = gRng;
+    return m;
+}
+
+static const EngineApi gBuiltinEngine = { ENGINE_ABI, sizeof(GameState), engineTurn, engineChooseMove };
+
+#ifdef TBC_ENGINE_SO
+__attribute__((visibility("default"))) const EngineApi tbcEngine = { ENGINE_ABI, sizeof(GameState), engineTurn, engineChooseMove };
+#endif
+
+typedef struct {
+    const char      *path;          /* NULL: builtin only */
+    void            *handle;
+    const EngineApi *api;
+    time_t           seenMtime, pendingMtime;   /* 1 s resolution; size breaks ties */
+    off_t            seenSize, pendingSize;
+    int              generation;
+} HotEngine;
+
+static HotEngine gEngine = { .api = &gBuiltinEngine };
+
+#ifndef _WIN32
+/* dlopen caches by path, so each generation is loaded from its own copy */
+static void *engineOpenCopy(const char *path, int generation) {
+    char live[512];
+    snprintf(live, sizeof(live), "%s.live%d", path, generation);
+    FILE *in = fopen(path, "rb"), *out = in ? fopen(live, "wb") : NULL;
+    if (!out) { if (in) fclose(in); return NULL; }
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) fwrite(buf, 1, n, out);
+    fclose(in);
+    fclose(out);
+    void *h = dlopen(live, RTLD_NOW | RTLD_LOCAL);
+    remove(live);   /* the mapping outlives the name */
+    return h;
+}
+#endif
+
+/* Loads the library if it changed (and has stopped changing since the last
+ * poll, so a half-written build is never opened). Call only where no engine
+ * call is in flight. Returns 1 when gs was touched. */
+int enginePoll(HotEngine *he, GameState *gs) {
+#ifdef _WIN32
+    if (he->path && !he->generation) fprintf(stderr, "--engine is not supported on Windows\n");
+    (void)gs;
+    return 0;
+#else
+    struct stat st;
+    if (!he->path || stat(he->path, &st) != 0) return 0;
+    if (st.st_mtime == he->seenMtime && st.st_size == he->seenSize) return 0;
+    if (st.st_mtime != he->pendingMtime || st.st_size != he->pendingSize) {
+        he->pendingMtime = st.st_mtime;
+        he->pendingSize  = st.st_size;
+        return 0;
+    }
+    he->seenMtime = st.st_mtime;
+    he->seenSize  = st.st_size;
+
+    char msg[128];
+    void *h = engineOpenCopy(he->path, he->generation + 1);
+    const EngineApi *api = h ? dlsym(h, "tbcEngine") : NULL;
+    if (!api || api->abi != ENGINE_ABI || api->stateSize != sizeof(GameState)) {
+        fprintf(stderr, "engine %s: %s\n", he->path, !h ? dlerror() : !api ? "no tbcEngine symbol" : "ABI mismatch, rebuild the game");
+        if (h) dlclose(h);
+        snprintf(msg, sizeof(msg), "Engine reload failed - kept gen %d", he->generation);
+    } else {
+        if (he->handle) dlclose(he->handle);
+        he->handle = h;
+        he->api    = api;
+        he->generation++;
+        snprintf(msg, sizeof(msg), "Engine reloaded (gen %d)", he->generation);
+    }
+    if (gs) { logAdd(&gs->log, msg); stateChanged(gs); }
+    return gs != NULL;
+#endif
+}
+
+/* ===================== SAVE / RESUME ===================== */
+/*
+ * The match is checkpointed after every resolved turn into a small fixed-size
+ * record (no log, no UI state), written to a temp file and renamed over
+ * SAVE_FILE so a crash or power cut leaves either the old or the new turn.
+ * On startup a valid record drops straight back onto the resolve screen.
+ * Bump SAVE_VERSION whenever the record layout changes; stale saves are ignored.
+ */
+#define SAVE_FILE    "tbc_save.bin"
+#define SAVE_MAGIC   0x53436254u   /* "TbCS" */
+#define SAVE_VERSION 2
+
+static int gSaveEnabled = 1;   /* off for scripted runs */
+
+typedef struct {
+    char    name[24];
+    int16_t hp, maxHp, defPenalty;
+    uint8_t classId, charge, buffActive, buffTurns, dotStacks, dotTurns;
+} SavedFighter;
+
+typedef struct {
+    uint32_t     magic;
+    uint16_t     version;
+    uint16_t     turn;
+    uint32_t     rng;
+    uint8_t      vsComputer, gauntletMode, selectedTarget, endless;
+    SavedFighter f[5];             /* p1, p2, enemies[0..2] */
+    uint16_t     wave, waveLeft;   /* endless only */
+    uint32_t     spawned;
+    uint32_t     checksum;
+} SaveRecord;
+
+_Static_assert(sizeof(SaveRecord) == 208, "save record layout changed - bump SAVE_VERSION");
+
+uint32_t fnv1a(const void *data, size_t n) {
+    const uint8_t *p = data;
+    uint32_t h = 2166136261u;
+    while (n--) { h ^= *p++; h *= 16777619u; }
+    return h;
+}
+
+void packFighter(SavedFighter *s, const Fighter *f) {
+    memset(s, 0, sizeof(*s));
+    size_t n = strlen(f->name);
+    memcpy(s->name, f->name, n < sizeof(s->name) ? n : sizeof(s->name)-1);
+    s->hp=(int16_t)f->hp; s->maxHp=(int16_t)f->maxHp; s->defPenalty=(int16_t)f->defPenalty;
+    s->classId=(uint8_t)f->classId; s->charge=(uint8_t)f->charge;
+    s->buffActive=(uint8_t)f->buffActive; s->buffTurns=(uint8_t)f->buffTurns;
+    s->dotStacks=(uint8_t)f->dotStacks; s->dotTurns=(uint8_t)f->dotTurns;
+}
+
+/* Base stats come from the class table, only the mutable fields are stored */
+void unpackFighter(Fighter *f, const SavedFighter *s) {
+    char name[sizeof(s->name)];
+    memcpy(name, s->name, sizeof(name)); name[sizeof(name)-1]='\0';
+    initFighter(f, name, s->classId);
+    f->hp=s->hp; f->maxHp=s->maxHp; f->defPenalty=s->defPenalty;
+    f->charge=s->charge; f->buffActive=s->buffActive; f->buffTurns=s->buffTurns;
+    f->dotStacks=s->dotStacks; f->dotTurns=s->dotTurns;
+}
+
+/* The checksum catches a damaged file, not a crafted one: everything used
+ * as an index or a loop bound has to be in range as well */
+static int savedFighterOk(const SavedFighter *s, int inPlay) {
+    return s->classId < 3 && s->charge <= MAX_CHARGE && s->dotStacks <= MAX_DOT_STACKS
+        && s->buffActive <= 1 && s->buffTurns <= 15 && s->dotTurns <= 15
+        && s->maxHp >= inPlay && s->maxHp <= 999 && s->hp <= s->maxHp && s->defPenalty >= 0 && s->defPenalty <= MAX_SUNDER;
+}
+
+void saveMatch(const GameState *gs) {
+    if (!gSaveEnabled) return;
+    SaveRecord r;
+    memset(&r, 0, sizeof(r));
+    r.magic=SAVE_MAGIC; r.version=SAVE_VERSION;
+    r.turn=(uint16_t)gs->turn; r.rng=gRng;
+    r.vsComputer=(uint8_t)gs->vsComputer; r.gauntletMode=(uint8_t)gs->gauntletMode;
+    r.selectedTarget=(uint8_t)gs->selectedTarget; r.endless=(uint8_t)gs->endless;
+    r.wave=(uint16_t)gs->wave; r.waveLeft=(uint16_t)gs->waveLeft; r.spawned=(uint32_t)gs->spawned;
+    packFighter(&r.f[0], &gs->p1);
+    packFighter(&r.f[1], &gs->p2);
+    for (int i=0;i<3;i++) packFighter(&r.f[2+i], &gs->enemies[i]);
+    r.checksum = fnv1a(&r, offsetof(SaveRecord, checksum));
+
+    FILE *f = fopen(SAVE_FILE ".tmp", "wb");
+    if (!f) return;
+    int ok = fwrite(&r, sizeof(r), 1, f) == 1 && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    fclose(f);
+    if (!ok) { remove(SAVE_FILE ".tmp"); return; }
+    if (rename(SAVE_FILE ".tmp", SAVE_FILE) != 0) {
+        /* Windows refuses to rename over an existing file */
+        remove(SAVE_FILE);
+        rename(SAVE_FILE ".tmp", SAVE_FILE);
+    }
+}
+
+void clearSavedMatch(void) { if (gSaveEnabled) remove(SAVE_FILE); }
+
+/* Returns 1 and fills gs if a valid checkpoint exists */
+int loadMatch(GameState *gs) {
+    SaveRecord r;
+    FILE *f = fopen(SAVE_FILE, "rb");
+    if (!f) return 0;
+    int ok = fread(&r, sizeof(r), 1, f) == 1;
+    fclose(f);
+    if (!ok || r.magic!=SAVE_MAGIC || r.version!=SAVE_VERSION ||
+        r.checksum != fnv1a(&r, offsetof(SaveRecord, checksum)))
+        return 0;
+    if (r.vsComputer > 4 || r.gauntletMode > 1 || r.endless > 1 || r.selectedTarget > 2 ||
+        r.turn < 1 || (r.turn > MAX_TURNS && !r.endless) || r.waveLeft > 999)
+        return 0;
+    /* unused slots (p2 in a solo gauntlet, enemies in a duel) are blank */
+    int p2InPlay = !r.gauntletMode || r.vsComputer == 4;
+    for (int i=0;i<5;i++)
+        if (!savedFighterOk(&r.f[i], i == 0 || (i == 1 ? p2InPlay : r.gauntletMode))) return 0;
+
+    memset(gs, 0, sizeof(*gs));
+    unpackFighter(&gs->p1, &r.f[0]);
+    unpackFighter(&gs->p2, &r.f[1]);
+    for (int i=0;i<3;i++) unpackFighter(&gs->enemies[i], &r.f[2+i]);
+    gs->turn=r.turn; gs->vsComputer=r.vsComputer; gs->gauntletMode=r.gauntletMode;
+    gs->selectedTarget=r.selectedTarget;
+    gRng = r.rng;
+    if (r.vsComputer==4 && r.gauntletMode) gs->coop=1;   /* both champions are in f[0..1] */
+    if (r.endless && r.gauntletMode) {
+        gs->endless=1; gs->wave=r.wave>0 ? r.wave : 1; gs->waveLeft=r.waveLeft; gs->spawned=(int)r.spawned;
+        /* only the mutable fields are saved: put the wave's ATK/DEF back */
+        for (int i=0;i<3;i++) endlessStats(&gs->enemies[i], gs->wave);
+    }
+
+    char buf[128];
+    snprintf(buf,128,"Match restored at turn %d/%d", gs->turn, MAX_TURNS);
+    logAdd(&gs->log, buf);
+    gs->screen = gs->gauntletMode ? SCREEN_GAUNTLET_RESOLVE : SCREEN_RESOLVE;
+    return 1;
+}
+
+/* Resolve the pending turn for the current mode, then checkpoint it */
+void runTurn(GameState *gs) {
+    logClear(&gs->log);
+    uint64_t t0 = nowNs();
+    gEngine.api->turn(gs, &gRng, gAi);
+    metricsTurn(nowNs()-t0);
+    stateChanged(gs);
+    saveMatch(gs);
+}
+
+/* ===================== INPUT ===================== */
+/*
+ * The game logic never calls raylib input directly: the render thread samples
+ * the keyboard once per frame into an InputFrame and hands it over. Only keys
+ * the screens react to are captured; F11 stays on the render thread.
+ */
+typedef enum {
+    BTN_UP, BTN_DOWN, BTN_LEFT, BTN_RIGHT, BTN_W, BTN_A, BTN_S, BTN_D,
+    BTN_ENTER, BTN_SPACE, BTN_1, BTN_2, BTN_3, BTN_4, BTN_COUNT
+} Button;
+
+static const int BUTTON_KEY[BTN_COUNT] = {
+    KEY_UP, KEY_DOWN, KEY_LEFT, KEY_RIGHT, KEY_W, KEY_A, KEY_S, KEY_D,
+    KEY_ENTER, KEY_SPACE, KEY_ONE, KEY_TWO, KEY_THREE, KEY_FOUR,
+};
+
+#define MAX_FRAME_LETTERS 8
+
+typedef struct {
+    uint32_t buttons;                    /* bit per Button pressed this frame */
+    char     letters[MAX_FRAME_LETTERS]; /* A-Z typed this frame (secret words) */
+    int      letterCount;
+    /* networked co-op: what the partner sent, see CO-OP LINK */
+    int      peerTurn;                   /* 0: no command this frame */
+    uint8_t  peerMove, peerTarget, peerLost;
+    uint32_t peerHash;
+} InputFrame;
+
+int pressed(const InputFrame *in, Button b) { return (int)((in->buttons >> b) & 1u); }
+int inputEmpty(const InputFrame *in) {
+    return in->buttons == 0 && in->letterCount == 0 && in->peerTurn == 0 && !in->peerLost;
+}
+
+void pollInput(InputFrame *in) {
+    memset(in, 0, sizeof(*in));
+    for (int b=0;b<BTN_COUNT;b++)
+        if (IsKeyPressed(BUTTON_KEY[b])) in->buttons |= 1u << b;
+    for (int key=GetKeyPressed(); key!=0; key=GetKeyPressed())
+        if (key >= 'A' && key <= 'Z' && in->letterCount < MAX_FRAME_LETTERS)
+            in->letters[in->letterCount++] = (char)key;
+}
+
+/* ===================== INPUT SCRIPTS ===================== */
+/*
+ * A script is a text file of input frames, replayed in place of the keyboard
+ * (--play) or written from a live session (--record):
+ *
+ *   seed 42              RNG seed for the run
+ *   gap 6                empty frames after every press/type line (default 0)
+ *   wait 30              30 frames with no input
+ *   press ENTER          one frame with these buttons down (UP+W, 1, SPACE...)
+ *   type GAUNTLET        one frame carrying these letters
+ *   repeat 40 press ENTER
+ *
+ * Everything after '#' is a comment.
+ */
+static const char *BUTTON_NAME[BTN_COUNT] = {
+    "UP","DOWN","LEFT","RIGHT","W","A","S","D","ENTER","SPACE","1","2","3","4",
+};
+
+typedef struct {
+    InputFrame *frames;
+    int         count, cap, pos;
+    uint32_t    seed;
+    int         hasSeed;
+} InputScript;
+
+void scriptAppend(InputScript *sc, const InputFrame *f) {
+    if (sc->count == sc->cap) {
+        sc->cap = sc->cap ? sc->cap*2 : 256;
+        sc->frames = realloc(sc->frames, (size_t)sc->cap * sizeof(InputFrame));
+    }
+    sc->frames[sc->count++] = *f;
+}
+
+/* Returns 0 and prints the offending line on a parse error */
+int scriptLoad(InputScript *sc, const char *path) {
+    memset(sc, 0, sizeof(*sc));
+    FILE *f = fopen(path, "r");
+    if (!f) { fprintf(stderr, "%s: cannot open\n", path); return 0; }
+
+    char line[256];
+    int lineNo = 0, gap = 0;
+    InputFrame empty = {0};
+    while (fgets(line, sizeof(line), f)) {
+        lineNo++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char cmd[16], arg[128];
+        int reps = 1, n = 0;
+        char *p = line;
+        if (sscanf(p, "%15s%n", cmd, &n) != 1) continue;
+        p += n;
+        if (!strcmp(cmd, "repeat")) {
+            if (sscanf(p, "%d %15s%n", &reps, cmd, &n) != 2 || reps < 0) goto bad;
+            p += n;
+        }
+        if (sscanf(p, "%127s", arg) != 1) goto bad;
+
+        if (!strcmp(cmd, "seed"))      { sc->seed = (uint32_t)strtoul(arg, NULL, 10); sc->hasSeed = 1; continue; }
+        if (!strcmp(cmd, "gap"))       { gap = atoi(arg); continue; }
+
+        InputFrame fr = {0};
+        int waitFrames = 0;
+        if (!strcmp(cmd, "wait")) {
+            waitFrames = atoi(arg);
+        } else if (!strcmp(cmd, "press")) {
+            for (char *tok = strtok(arg, "+"); tok; tok = strtok(NULL, "+")) {
+                int b = 0;
+                while (b < BTN_COUNT && strcmp(tok, BUTTON_NAME[b])) b++;
+                if (b == BTN_COUNT) goto bad;
+                fr.buttons |= 1u << b;
+            }
+        } else if (!strcmp(cmd, "type")) {
+            for (char *c = arg; *c && fr.letterCount < MAX_FRAME_LETTERS; c++)
+                if (*c >= 'A' && *c <= 'Z') fr.letters[fr.letterCount++] = *c;
+        } else goto bad;
+
+        for (int r=0;r<reps;r++) {
+            if (waitFrames) { for (int i=0;i<waitFrames;i++) scriptAppend(sc, &empty); continue; }
+            scriptAppend(sc, &fr);
+            for (int i=0;i<gap;i++) scriptAppend(sc, &empty);
+        }
+    }
+    fclose(f);
+    return 1;
+bad:
+    fprintf(stderr, "%s:%d: cannot parse: %s", path, lineNo, line);
+    fclose(f);
+    free(sc->frames);
+    return 0;
+}
+
+int scriptNext(InputScript *sc, InputFrame *in) {
+    if (sc->pos >= sc->count) return 0;
+    *in = sc->frames[sc->pos++];
+    return 1;
+}
+
+/* Writes live input in the same format; idle frames collapse into waits */
+typedef struct {
+    FILE *f;
+    int   idle;
+} InputRecorder;
+
+void recordFrame(InputRecorder *rec, const InputFrame *in) {
+    if (!rec->f) return;
+    if (inputEmpty(in)) { rec->idle++; return; }
+    if (rec->idle) fprintf(rec->f, "wait %d\n", rec->idle);
+    rec->idle = 0;
+    if (in->buttons) {
+        fprintf(rec->f, "press ");
+        for (int b=0, first=1; b<BTN_COUNT; b++)
+            if (pressed(in, b)) { fprintf(rec->f, "%s%s", first?"":"+", BUTTON_NAME[b]); first=0; }
+        fprintf(rec->f, "\n");
+    }
+    if (in->letterCount)
+        fprintf(rec->f, "type %.*s\n", in->letterCount, in->letters);
+}
+
+/* ===================== FRAME TIMING REPORT ===================== */
+/*
+ * Per-frame timings for scripted benchmark runs. build = update + HUD + draw
+ * list, submit = batch flush, blit and EndDrawing. Raylib has no GPU timer
+ * queries, but with the frame cap off the swap in EndDrawing blocks once the
+ * GPU falls behind, so submit time is where GPU cost shows up.
+ */
+typedef struct { float buildMs, submitMs, frameMs; uint8_t screen; } FrameSample;
+
+typedef struct {
+    FrameSample *s;
+    int          count, cap;
+} FrameReport;
+
+void reportAdd(FrameReport *r, FrameSample fs) {
+    if (r->count == r->cap) {
+        r->cap = r->cap ? r->cap*2 : 4096;
+        r->s = realloc(r->s, (size_t)r->cap * sizeof(FrameSample));
+    }
+    r->s[r->count++] = fs;
+}
+
+int cmpFloat(const void *a, const void *b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+void reportWrite(const FrameReport *r, const char *path) {
+    if (r->count == 0) return;
+    FILE *f = fopen(path, "w");
+    if (f) {
+        fprintf(f, "frame,screen,build_ms,submit_ms,frame_ms\n");
+        for (int i=0;i<r->count;i++)
+            fprintf(f, "%d,%d,%.3f,%.3f,%.3f\n", i, r->s[i].screen, r->s[i].buildMs, r->s[i].submitMs, r->s[i].frameMs);
+        fclose(f);
+    }
+
+    float *ft = malloc((size_t)r->count * sizeof(float));
+    double sum = 0, build = 0, submit = 0;
+    for (int i=0;i<r->count;i++) {
+        ft[i] = r->s[i].frameMs; sum += ft[i];
+        build += r->s[i].buildMs; submit += r->s[i].submitMs;
+    }
+    qsort(ft, (size_t)r->count, sizeof(float), cmpFloat);
+    int n = r->count;
+    printf("frames %d  mean %.3f ms  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f  (build %.3f, submit %.3f)\n",
+           n, sum/n, ft[n/2], ft[(int)(n*0.95)], ft[(int)(n*0.99)], ft[n-1], build/n, submit/n);
+    free(ft);
+}
+
+/* ===================== REPLAY EXPORT ===================== */
+/*
+ * --export DIR renders a --play script in a hidden window and writes every
+ * frame as DIR/frame_NNNNNN.png. The main thread only draws and reads the
+ * target back; flipping and PNG compression (the slow part) run on a pool of
+ * encoder threads fed through a bounded queue, so a match exports well
+ * faster than it plays. Stitch with:
+ *   ffmpeg -framerate 60 -i DIR/frame_%06d.png -pix_fmt yuv420p match.mp4
+ */
+#define EXPORT_MAX_THREADS 16
+
+typedef struct { Image img; int index; } ExportJob;
+
+typedef struct {
+    const char     *dir;
+    pthread_t       threads[EXPORT_MAX_THREADS];
+    int             threadCount;
+    ExportJob      *jobs;          /* ring of cap entries */
+    int             cap, head, count;
+    int             done, failed;
+    pthread_mutex_t lock;
+    pthread_cond_t  notEmpty, notFull;
+} FrameExporter;
+
+static void *exportThreadMain(void *arg) {
+    FrameExporter *ex = arg;
+    for (;;) {
+        pthread_mutex_lock(&ex->lock);
+        while (ex->count == 0 && !ex->done) pthread_cond_wait(&ex->notEmpty, &ex->lock);
+        if (ex->count == 0) { pthread_mutex_unlock(&ex->lock); return NULL; }
+        ExportJob job = ex->jobs[ex->head];
+        ex->head = (ex->head + 1) % ex->cap;
+        ex->count--;
+        pthread_cond_signal(&ex->notFull);
+        pthread_mutex_unlock(&ex->lock);
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/frame_%06d.png", ex->dir, job.index);
+        ImageFlipVertical(&job.img);   /* render targets come back bottom-up */
+        int ok = ExportImage(job.img, path);
+        UnloadImage(job.img);
+        if (!ok) {
+            pthread_mutex_lock(&ex->lock);
+            ex->failed++;
+            pthread_mutex_unlock(&ex->lock);
+        }
+    }
+}
+
+/* Makes DIR if needed; 0 (with a message) if it still isn't a directory */
+int exportDirReady(const char *dir) {
+#ifdef _WIN32
+    int made = _mkdir(dir);
+#else
+    int made = mkdir(dir, 0777);
+#endif
+    struct stat st;
+    if (made != 0 && errno != EEXIST) { fprintf(stderr, "%s: cannot create: %s\n", dir, strerror(errno)); return 0; }
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) { fprintf(stderr, "%s: not a directory\n", dir); return 0; }
+    return 1;
+}
+
+/* Returns 0 if the queue can't be allocated (nothing is started then) */
+int exporterStart(FrameExporter *ex, const char *dir) {
+    memset(ex, 0, sizeof(*ex));
+    ex->dir = dir;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    ex->threadCount = cpus > 1 ? (int)(cpus - 1) : 1;   /* leave one for drawing */
+    if (ex->threadCount > EXPORT_MAX_THREADS) ex->threadCount = EXPORT_MAX_THREADS;
+    ex->cap  = ex->threadCount * 2;
+    ex->jobs = malloc((size_t)ex->cap * sizeof(ExportJob));
+    if (!ex->jobs) return 0;
+    pthread_mutex_init(&ex->lock, NULL);
+    pthread_cond_init(&ex->notEmpty, NULL);
+    pthread_cond_init(&ex->notFull, NULL);
+    for (int i=0;i<ex->threadCount;i++) pthread_create(&ex->threads[i], NULL, exportThreadMain, ex);
+    return 1;
+}
+
+/* Takes ownership of img; blocks while every encoder is busy */
+void exporterSubmit(FrameExporter *ex, Image img, int index) {
+    pthread_mutex_lock(&ex->lock);
+    while (ex->count == ex->cap) pthread_cond_wait(&ex->notFull, &ex->lock);
+    ex->jobs[(ex->head + ex->count) % ex->cap] = (ExportJob){ img, index };
+    ex->count++;
+    pthread_cond_signal(&ex->notEmpty);
+    pthread_mutex_unlock(&ex->lock);
+}
+
+/* Drains the queue and joins the pool; returns the number of failed writes */
+int exporterFinish(FrameExporter *ex) {
+    pthread_mutex_lock(&ex->lock);
+    ex->done = 1;
+    pthread_cond_broadcast(&ex->notEmpty);
+    pthread_mutex_unlock(&ex->lock);
+    for (int i=0;i<ex->threadCount;i++) pthread_join(ex->threads[i], NULL);
+    pthread_mutex_destroy(&ex->lock);
+    pthread_cond_destroy(&ex->notEmpty);
+    pthread_cond_destroy(&ex->notFull);
+    free(ex->jobs);
+    return ex->failed;
+}
+
+/* ===================== CO-OP LINK ===================== */
+/*
+ * Networked co-op runs in lockstep on commands, not frames: menus, cursors
+ * and the resolve screen stay local, and the only traffic is one 12-byte
+ * command per champion per turn (move, target, and a hash of the state it
+ * was picked on; a fallen champion sends a pass). Both peers start from the host's seed and play
+ * the two commands in seat order, so they resolve every turn bit for bit; a
+ * hash mismatch ends the match rather than playing on diverged.
+ *   receive: the render thread drains the link once per frame and hands a
+ *            command to updateGame inside the InputFrame, like a keypress.
+ *   send:    whoever runs updateGame calls coopSend after each frame, which
+ *            spots the local champion's lock-in and ships it.
+ * The link is TCP (--coop-host PORT / --coop-join HOST:PORT, Nagle off), or
+ * an in-process loopback pipe pair that --coop-test plays two peers over.
+ */
+#define COOP_MSG_SIZE 12
+#define COOP_PIPE_LEN 16   /* power of two; lockstep keeps at most one in flight */
+
+enum { COOP_HELLO = 1, COOP_CMD = 2 };
+
+/* HELLO: a = class, turn = ENGINE_ABI, word = seed (the host's is used)
+ * CMD:   a = move, b = target, turn, word = coopHash before the turn */
+typedef struct { uint8_t kind, a, b; uint32_t turn, word; } CoopMsg;
+
+void coopPack(uint8_t *out, const CoopMsg *m) {
+    memset(out, 0, COOP_MSG_SIZE);
+    out[0]=m->kind; out[1]=m->a; out[2]=m->b;
+    for (int i=0;i<4;i++) { out[4+i]=(uint8_t)(m->turn>>(8*i)); out[8+i]=(uint8_t)(m->word>>(8*i)); }
+}
+
+void coopUnpack(CoopMsg *m, const uint8_t *in) {
+    m->kind=in[0]; m->a=in[1]; m->b=in[2]; m->turn=m->word=0;
+    for (int i=0;i<4;i++) { m->turn|=(uint32_t)in[4+i]<<(8*i); m->word|=(uint32_t)in[8+i]<<(8*i); }
+}
+
+/* One direction of a loopback link: single producer, single consumer */
+typedef struct {
+    CoopMsg     buf[COOP_PIPE_LEN];
+    atomic_uint head, tail;
+    atomic_int  closed;
+} CoopPipe;
+
+typedef struct CoopLink CoopLink;
+struct CoopLink {
+    int  (*send)(CoopLink *l, const CoopMsg *m);   /* 0: link is gone */
+    int  (*recv)(CoopLink *l, CoopMsg *m);         /* 1 got one, 0 nothing yet, -1 gone */
+    void (*close)(CoopLink *l);
+    int       fd;                    /* tcp */
+    uint8_t   part[COOP_MSG_SIZE];   /* tcp: message read so far */
+    int       partLen;
+    CoopPipe *in, *out;              /* loopback */
+    int       seat;
+    int       sentTurn;              /* sender side only */
+    int       lost;                  /* receiver side only */
+};
+
+static int pipeSend(CoopLink *l, const CoopMsg *m) {
+    CoopPipe *p = l->out;
+    unsigned h = atomic_load_explicit(&p->head, memory_order_relaxed);
+    unsigned t = atomic_load_explicit(&p->tail, memory_order_acquire);
+    if (atomic_load(&p->closed) || h - t == COOP_PIPE_LEN) return 0;
+    p->buf[h & (COOP_PIPE_LEN-1)] = *m;
+    atomic_store_explicit(&p->head, h+1, memory_order_release);
+    return 1;
+}
+
+static int pipeRecv(CoopLink *l, CoopMsg *m) {
+    CoopPipe *p = l->in;
+    unsigned t = atomic_load_explicit(&p->tail, memory_order_relaxed);
+    unsigned h = atomic_load_explicit(&p->head, memory_order_acquire);
+    if (t == h) return atomic_load(&p->closed) ? -1 : 0;
+    *m = p->buf[t & (COOP_PIPE_LEN-1)];
+    atomic_store_explicit(&p->tail, t+1, memory_order_release);
+    return 1;
+}
+
+/* The partner reads what is already queued, then sees the link gone */
+static void pipeClose(CoopLink *l) {
+    atomic_store(&l->out->closed, 1);
+    atomic_store(&l->in->closed, 1);
+}
+
+/* Joins a (seat 0) and b (seat 1) through pipes[2] */
+void coopLoopback(CoopLink *a, CoopLink *b, CoopPipe pipes[2]) {
+    memset(pipes, 0, 2*sizeof(CoopPipe));
+    memset(a, 0, sizeof(*a));
+    memset(b, 0, sizeof(*b));
+    a->in = &pipes[0]; a->out = &pipes[1];
+    b->in = &pipes[1]; b->out = &pipes[0];
+    b->seat = 1;
+    a->send = b->send = pipeSend;
+    a->recv = b->recv = pipeRecv;
+    a->close = b->close = pipeClose;
+    a->fd = b->fd = -1;
+}
+
+#ifndef _WIN32
+static int tcpSend(CoopLink *l, const CoopMsg *m) {
+    uint8_t b[COOP_MSG_SIZE];
+    coopPack(b, m);
+    for (size_t off = 0; off < sizeof(b); ) {
+        ssize_t n = send(l->fd, b+off, sizeof(b)-off, 0);
+        if (n > 0) off += (size_t)n;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+        else return 0;
+    }
+    return 1;
+}
+
+static int tcpRecv(CoopLink *l, CoopMsg *m) {
+    ssize_t n = recv(l->fd, l->part + l->partLen, (size_t)(COOP_MSG_SIZE - l->partLen), 0);
+    if (n == 0) return -1;
+    if (n < 0)  return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    l->partLen += (int)n;
+    if (l->partLen < COOP_MSG_SIZE) return 0;
+    l->partLen = 0;
+    coopUnpack(m, l->part);
+    return 1;
+}
+
+static void tcpClose(CoopLink *l) {
+    if (l->fd >= 0) close(l->fd);
+    l->fd = -1;
+}
+
+/* Blocking: the host (addr = PORT) waits for one partner, the joiner
+ * (addr = HOST:PORT) connects; then HELLOs are swapped and the socket goes
+ * non-blocking. Fills seed (the host's) and both champions' classes. */
+int coopOpen(CoopLink *l, const char *addr, int host, int cls, uint32_t *seed, int classes[2]) {
+    memset(l, 0, sizeof(*l));
+    l->fd = -1;
+    l->seat = host ? 0 : 1;
+    l->send = tcpSend; l->recv = tcpRecv; l->close = tcpClose;
+    signal(SIGPIPE, SIG_IGN);   /* a dropped partner is a failed send, not a kill */
+
+    char name[256];
+    snprintf(name, sizeof(name), "%s", addr);
+    char *port = name, *colon = strrchr(name, ':');
+    if (!host) {
+        if (!colon) { fprintf(stderr, "--coop-join wants HOST:PORT\n"); return 0; }
+        *colon = '\0';
+        port = colon + 1;
+    }
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = host ? AI_PASSIVE : 0;
+    int err = getaddrinfo(host ? NULL : name, port, &hints, &res);
+    if (err) { fprintf(stderr, "%s: %s\n", addr, gai_strerror(err)); return 0; }
+    for (struct addrinfo *ai = res; ai && l->fd < 0; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (host) {
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 1) == 0) {
+                printf("waiting for a partner on port %s...\n", port);
+                fflush(stdout);
+                l->fd = accept(fd, NULL, NULL);
+            }
+            close(fd);
+        } else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            l->fd = fd;
+        } else {
+            close(fd);
+        }
+    }
+    freeaddrinfo(res);
+    if (l->fd < 0) { fprintf(stderr, "%s: %s\n", addr, strerror(errno)); return 0; }
+    int one = 1;
+    setsockopt(l->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    /* joiner speaks first; the host answers with the seed */
+    CoopMsg mine = { COOP_HELLO, (uint8_t)cls, 0, ENGINE_ABI, *seed }, theirs;
+    int r = 1;
+    if (!host) r = tcpSend(l, &mine);
+    while (r > 0 && (r = tcpRecv(l, &theirs)) == 0) {}
+    if (r > 0 && host) r = tcpSend(l, &mine);
+    if (r <= 0 || theirs.kind != COOP_HELLO || theirs.turn != ENGINE_ABI || theirs.a > 2) {
+        fprintf(stderr, "%s: %s\n", addr, r <= 0 ? "partner hung up" : "partner runs a different build");
+        tcpClose(l);
+        return 0;
+    }
+    if (!host) *seed = theirs.word;
+    classes[l->seat]   = cls;
+    classes[l->seat^1] = theirs.a;
+    fcntl(l->fd, F_SETFL, fcntl(l->fd, F_GETFL) | O_NONBLOCK);
+    return 1;
+}
+#else
+int coopOpen(CoopLink *l, const char *addr, int host, int cls, uint32_t *seed, int classes[2]) {
+    (void)l; (void)addr; (void)host; (void)cls; (void)seed; (void)classes;
+    fprintf(stderr, "networked co-op is not supported on Windows\n");
+    return 0;
+}
+#endif
+
+/* What both peers must agree on before a turn: fighters, turn, RNG word */
+uint32_t coopHash(const GameState *gs) {
+    const Fighter *f[5] = {&gs->p1, &gs->p2, &gs->enemies[0], &gs->enemies[1], &gs->enemies[2]};
+    int32_t v[5*8+2];
+    int n = 0;
+    for (int i=0;i<5;i++) {
+        v[n++]=f[i]->hp; v[n++]=f[i]->maxHp; v[n++]=f[i]->charge; v[n++]=f[i]->classId;
+        v[n++]=f[i]->baseAtk; v[n++]=f[i]->defPenalty;
+        v[n++]=f[i]->buffActive*16 + f[i]->buffTurns;
+        v[n++]=f[i]->dotStacks*16  + f[i]->dotTurns;
+    }
+    v[n++]=gs->turn; v[n++]=(int32_t)gRng;
+    return fnv1a(v, sizeof(v));
+}
+
+/* Call after every updateGame, on the thread that runs it */
+void coopSend(CoopLink *l, const GameState *gs) {
+    if (gs->coop != 2 || !(gs->locked >> l->seat & 1) || gs->turn == l->sentTurn) return;
+    int s = l->seat;
+    CoopMsg m = { COOP_CMD, (uint8_t)(s ? gs->gauntletMove2 : gs->gauntletMove),
+                  (uint8_t)(s ? gs->selectedTarget2 : gs->selectedTarget), (uint32_t)gs->turn, gs->netHash };
+    l->sentTurn = gs->turn;
+    l->send(l, &m);   /* a dead link shows up on the receive side */
+}
+
+/* Once per frame: the partner's command, or the news that the link is gone.
+ * One command per frame: the partner may already be a turn ahead, and its
+ * next command must not overwrite the one this turn still needs. */
+void coopRecv(CoopLink *l, InputFrame *in) {
+    if (l->lost) return;
+    CoopMsg m;
+    int r;
+    while ((r = l->recv(l, &m)) > 0) {
+        if (m.kind != COOP_CMD) continue;
+        in->peerTurn = (int)m.turn; in->peerMove = m.a; in->peerTarget = m.b; in->peerHash = m.word;
+        return;
+    }
+    if (r < 0) { l->lost = 1; in->peerLost = 1; }
+}
+
+/* ===================== GAME UPDATE ===================== */
+
+/* Next living enemy from t, stepping 1 (right) or 2 (left) */
+static int nextTarget(const GameState *gs, int t, int step) {
+    int u=t;
+    do { u=(u+step)%3; } while(gs->enemies[u].hp<=0 && u!=t);
+    return u;
+}
+
+/* One co-op champion's cursor. Locking in fixes its move until the turn runs. */
+static void coopSteer(GameState *gs, int s, int up, int down, int left, int right, int lock) {
+    Fighter *c = s ? &gs->p2 : &gs->p1;
+    int *sel = s ? &gs->selectedMove2 : &gs->selectedMove;
+    int *tgt = s ? &gs->selectedTarget2 : &gs->selectedTarget;
+    if (c->hp <= 0 || (gs->locked >> s & 1)) return;
+
+    if (up)    *sel=(*sel+4)%5;
+    if (down)  *sel=(*sel+1)%5;
+    if (left)  *tgt=nextTarget(gs, *tgt, 2);
+    if (right) *tgt=nextTarget(gs, *tgt, 1);
+    if (lock && c->charge >= getMoves(c->classId)[*sel].cost) {
+        *(s ? &gs->gauntletMove2 : &gs->gauntletMove) = *sel;
+        gs->locked |= 1 << s;
+        if (gs->coop == 2) gs->netHash = coopHash(gs);
+        stateChanged(gs);
+    }
+}
+
+/* Start of a co-op turn: a fallen champion on this side passes at once, so
+ * a networked peer still sends one command per turn and neither side can
+ * run more than a turn ahead of the other. */
+void coopNewTurn(GameState *gs) {
+    gs->locked = 0;
+    for (int s=0;s<2;s++)
+        if ((gs->coop == 1 || s == gs->seat) && (s ? gs->p2.hp : gs->p1.hp) <= 0) gs->locked |= 1 << s;
+    if (gs->coop == 2 && (gs->locked >> gs->seat & 1)) gs->netHash = coopHash(gs);
+}
+
+/* Runs the co-op turn once every seat is locked in or (networked) covered
+ * by the partner's command for it. Checked after input and again as each
+ * turn starts, since a seat may already be ready with no key pressed. */
+static void coopTryTurn(GameState *gs) {
+    Fighter *partner = gs->seat ? &gs->p1 : &gs->p2;
+    if (gs->coop == 2 && gs->peerTurn < 0 && partner->hp > 0) {
+        snprintf(gs->resultMsg,128,"Your partner disconnected.");
+        gs->screen=SCREEN_RESULT;
+        return;
+    }
+    /* a partner who left after falling has nothing more to say */
+    int peer = gs->coop == 2 && (gs->peerTurn == gs->turn || gs->peerTurn < 0);
+    for (int s=0;s<2;s++)
+        if (!(gs->locked >> s & 1) && !(peer && s != gs->seat)) return;
+    if (gs->coop == 2 && gs->peerTurn == gs->turn) {
+        /* the partner's end checked the move's cost; one it couldn't pay for
+         * didn't come from a game in step with ours */
+        int move = gs->peerMove % 5;
+        if (gs->peerHash != coopHash(gs) || (partner->hp > 0 && getMoves(partner->classId)[move].cost > partner->charge)) {
+            snprintf(gs->resultMsg,128,"Out of sync with your partner - match abandoned.");
+            gs->screen=SCREEN_RESULT;
+            return;
+        }
+        *(gs->seat ? &gs->gauntletMove   : &gs->gauntletMove2)   = move;
+        *(gs->seat ? &gs->selectedTarget : &gs->selectedTarget2) = gs->peerTarget % 3;
+    }
+    runTurn(gs);
+    gs->screen=SCREEN_GAUNTLET_RESOLVE;
+}
+
+/* Split keyboard: W/S A/D SPACE for champion 1, arrows ENTER for champion 2.
+ * Networked: either set steers our seat. */
+static void coopBattle(GameState *gs, const InputFrame *in) {
+    if (gs->coop == 1) {
+        coopSteer(gs, 0, pressed(in,BTN_W), pressed(in,BTN_S), pressed(in,BTN_A), pressed(in,BTN_D), pressed(in,BTN_SPACE));
+        coopSteer(gs, 1, pressed(in,BTN_UP), pressed(in,BTN_DOWN), pressed(in,BTN_LEFT), pressed(in,BTN_RIGHT), pressed(in,BTN_ENTER));
+    } else {
+        coopSteer(gs, gs->seat, pressed(in,BTN_W)||pressed(in,BTN_UP), pressed(in,BTN_S)||pressed(in,BTN_DOWN),
+                  pressed(in,BTN_A)||pressed(in,BTN_LEFT), pressed(in,BTN_D)||pressed(in,BTN_RIGHT),
+                  pressed(in,BTN_ENTER)||pressed(in,BTN_SPACE));
+    }
+    coopTryTurn(gs);
+}
+
+/* Advance the state machine by one frame of input. Pure game logic: no
+ * drawing and no raylib calls, so it can run on any thread. */
+void updateGame(GameState *gs, const InputFrame *in) {
+    GameScreen prevScreen = gs->screen;
+
+    /* A match plays out on the balance it started with; between matches
+     * (before the first pick, or on the result screen) it follows the live one */
+    if (!gs->bal || gs->screen==SCREEN_MENU || gs->screen==SCREEN_SELECT_CLASS_P1 || gs->screen==SCREEN_RESULT)
+        balRepin(&gs->bal);
+    gBal = gs->bal->bal;
+
+    /* Networked co-op: the partner's command waits in gs until its turn;
+     * peerTurn -1 marks them gone, which only matters if we need them */
+    if (gs->coop == 2) {
+        if (in->peerTurn) {
+            gs->peerTurn=in->peerTurn; gs->peerMove=in->peerMove;
+            gs->peerTarget=in->peerTarget; gs->peerHash=in->peerHash;
+        }
+        if (in->peerLost) gs->peerTurn = -1;
+    }
+
+    switch (gs->screen) {
+
+        case SCREEN_MENU:
+            if (pressed(in,BTN_1)) { gs->vsComputer=1; gs->screen=SCREEN_SELECT_CLASS_P1; gs->hoverClass=0; }
+            if (pressed(in,BTN_2)) { gs->vsComputer=0; gs->screen=SCREEN_SELECT_CLASS_P1; gs->hoverClass=0; }
+            if (pressed(in,BTN_3)) gs->postChoice=3;
+
+            /* Secrets: type GAUNTLET to unlock 3v1 mode, ENDLESS for its
+             * wave survival variant, COOP for two champions on one keyboard,
+             * DASHBOARD for the balance dashboard. The buffer keeps the last
+             * 15 letters. */
+            for (int k=0;k<in->letterCount;k++) {
+                static const char *secret[4] = { "GAUNTLET", "DASHBOARD", "ENDLESS", "COOP" };
+                if (gs->secretLen == 15) {
+                    /* shift buffer left */
+                    memmove(gs->secretBuf, gs->secretBuf+1, 14);
+                    gs->secretLen = 14;
+                }
+                gs->secretBuf[gs->secretLen++] = (char)in->letters[k];
+                gs->secretBuf[gs->secretLen]   = '\0';
+                int hit = -1;
+                for (int s=0;s<4;s++) {
+                    int n = (int)strlen(secret[s]);
+                    if (gs->secretLen >= n && !strcmp(gs->secretBuf + gs->secretLen - n, secret[s])) hit = s;
+                }
+                if (hit < 0) continue;
+                gs->secretLen = 0;
+                gs->secretBuf[0] = '\0';
+                gs->hoverClass = 0;
+                if (hit == 1) {
+                    gs->screen = SCREEN_DASHBOARD;
+                } else {
+                    /* Unlock! Go to class select for gauntlet */
+                    gs->vsComputer = hit == 0 ? 2 : hit == 2 ? 3 : 4; /* 2 = gauntlet flag, 3 = endless, 4 = co-op */
+                    gs->screen = SCREEN_SELECT_CLASS_P1;
+                }
+                break;
+            }
+            break;
+
+        case SCREEN_DASHBOARD:
+            if (pressed(in,BTN_LEFT)  || pressed(in,BTN_A)) gs->hoverClass = (gs->hoverClass+2) % 3;
+            if (pressed(in,BTN_RIGHT) || pressed(in,BTN_D)) gs->hoverClass = (gs->hoverClass+1) % 3;
+            if (pressed(in,BTN_ENTER) || pressed(in,BTN_SPACE)) gs->screen = SCREEN_MENU;
+            break;
+
+        case SCREEN_SELECT_CLASS_P1: {
+            int c=-1;
+            if (pressed(in,BTN_1)) c=0;
+            if (pressed(in,BTN_2)) c=1;
+            if (pressed(in,BTN_3)) c=2;
+            if (c>=0) {
+                if (gs->vsComputer==4) {
+                    /* Co-op: champion 2 picks next */
+                    initFighter(&gs->p1, "Champion 1", c);
+                    gs->screen=SCREEN_SELECT_CLASS_P2;
+                } else if (gs->vsComputer>=2) {
+                    /* Gauntlet mode */
+                    initFighter(&gs->p1, "Champion", c);
+                    initGauntlet(gs);
+                    if (gs->vsComputer==3) endlessStart(gs);
+                    gs->screen=SCREEN_GAUNTLET_BATTLE;
+                } else {
+                    initFighter(&gs->p1, gs->vsComputer?"Player":"Player 1", c);
+                    gs->screen = gs->vsComputer ? SCREEN_SELECT_OPPONENT : SCREEN_SELECT_CLASS_P2;
+                }
+                gs->hoverClass=0;
+            }
+            if (pressed(in,BTN_UP))   gs->hoverClass=(gs->hoverClass+2)%3;
+            if (pressed(in,BTN_DOWN)) gs->hoverClass=(gs->hoverClass+1)%3;
+            break;
+        }
+
+        case SCREEN_SELECT_CLASS_P2: {
+            int c=-1;
+            if (pressed(in,BTN_1)) c=0;
+            if (pressed(in,BTN_2)) c=1;
+            if (pressed(in,BTN_3)) c=2;
+            if (c>=0 && gs->vsComputer==4) {
+                initFighter(&gs->p2, "Champion 2", c);
+                initGauntlet(gs);
+                coopStart(gs, 1, 0);
+                gs->screen=SCREEN_GAUNTLET_BATTLE;
+            } else if (c>=0) {
+                initFighter(&gs->p2, "Player 2", c);
+                gs->screen=SCREEN_BATTLE;
+                gs->turn=1; gs->selectedMove=0; gs->p1chosen=0;
+                logClear(&gs->log);
+            }
+            if (pressed(in,BTN_UP))   gs->hoverClass=(gs->hoverClass+2)%3;
+            if (pressed(in,BTN_DOWN)) gs->hoverClass=(gs->hoverClass+1)%3;
+            break;
+        }
+
+        case SCREEN_SELECT_OPPONENT: {
+            int chosen=-1;
+            if (pressed(in,BTN_1)) chosen=0;
+            if (pressed(in,BTN_2)) chosen=1;
+            if (pressed(in,BTN_3)) chosen=2;
+            if (pressed(in,BTN_4)) chosen=(int)(nextRng()%3);
+            if (chosen>=0) {
+                static const char *cn[3]={"Knight","Magician","Alchemist"};
+                initFighter(&gs->p2, cn[chosen], chosen);
+                gs->screen=SCREEN_BATTLE;
+                gs->turn=1; gs->selectedMove=0; gs->p1chosen=0;
+                logClear(&gs->log);
+            }
+            if (pressed(in,BTN_UP))   gs->hoverClass=(gs->hoverClass+3)%4;
+            if (pressed(in,BTN_DOWN)) gs->hoverClass=(gs->hoverClass+1)%4;
+            break;
+        }
+
+        case SCREEN_BATTLE: {
+            /* move selection with keyboard */
+            Fighter *cf = (!gs->vsComputer && gs->p1chosen) ? &gs->p2 : &gs->p1;
+            Move *moves = getMoves(cf->classId);
+
+            if (pressed(in,BTN_UP)||pressed(in,BTN_W))
+                gs->selectedMove=(gs->selectedMove+4)%5;
+            if (pressed(in,BTN_DOWN)||pressed(in,BTN_S))
+                gs->selectedMove=(gs->selectedMove+1)%5;
+
+            if (pressed(in,BTN_ENTER)||pressed(in,BTN_SPACE)) {
+                int idx=gs->selectedMove;
+                if (cf->charge < moves[idx].cost) break; /* locked, ignore */
+
+                if (gs->vsComputer) {
+                    gs->moveP1=idx;
+                    gs->moveP2=gEngine.api->chooseMove(&gs->p2,&gs->p1,&gRng,gAi);
+                    runTurn(gs);
+                    gs->screen=SCREEN_RESOLVE;
+                } else {
+                    if (!gs->p1chosen) {
+                        gs->moveP1=idx;
+                        gs->p1chosen=1;
+                        stateChanged(gs);
+                        gs->selectedMove=0;
+                    } else {
+                        gs->moveP2=idx;
+                        gs->p1chosen=0;
+                        runTurn(gs);
+                        gs->screen=SCREEN_RESOLVE;
+                    }
+                }
+            }
+            break;
+        }
+
+        case SCREEN_RESOLVE:
+            if (pressed(in,BTN_ENTER)||pressed(in,BTN_SPACE)) {
+                int d1=(gs->p1.hp<=0), d2=(gs->p2.hp<=0);
+                if (d1||d2) {
+                    if (d1&&d2) strncpy(gs->resultMsg,"DRAW! Both fell!",127);
+                    else if(d1) snprintf(gs->resultMsg,128,"%s WINS!",gs->p2.name);
+                    else        snprintf(gs->resultMsg,128,"%s WINS!",gs->p1.name);
+                    gs->screen=SCREEN_RESULT;
+                } else if (gs->turn >= MAX_TURNS) {
+                    if      (gs->p1.hp>gs->p2.hp) snprintf(gs->resultMsg,128,"%s WINS by HP!",gs->p1.name);
+                    else if (gs->p2.hp>gs->p1.hp) snprintf(gs->resultMsg,128,"%s WINS by HP!",gs->p2.name);
+                    else    strncpy(gs->resultMsg,"DRAW! Equal HP!",127);
+                    gs->screen=SCREEN_RESULT;
+                } else {
+                    gs->turn++;
+                    gs->selectedMove=0;
+                    gs->p1chosen=0;
+                    logClear(&gs->log);   /* clear log so battle screen is clean */
+                    gs->screen=SCREEN_BATTLE;
+                }
+            }
+            break;
+
+        case SCREEN_GAUNTLET_BATTLE: {
+            if (gs->coop) { coopBattle(gs, in); break; }
+            Fighter *p = &gs->p1;
+            Move *moves = getMoves(p->classId);
+
+            if (pressed(in,BTN_UP)||pressed(in,BTN_W))
+                gs->selectedMove=(gs->selectedMove+4)%5;
+            if (pressed(in,BTN_DOWN)||pressed(in,BTN_S))
+                gs->selectedMove=(gs->selectedMove+1)%5;
+
+            /* LEFT/RIGHT to cycle living targets */
+            if (pressed(in,BTN_LEFT)||pressed(in,BTN_A))  gs->selectedTarget=nextTarget(gs, gs->selectedTarget, 2);
+            if (pressed(in,BTN_RIGHT)||pressed(in,BTN_D)) gs->selectedTarget=nextTarget(gs, gs->selectedTarget, 1);
+
+            if (pressed(in,BTN_ENTER)||pressed(in,BTN_SPACE)) {
+                int idx=gs->selectedMove;
+                if (p->charge < moves[idx].cost) break;
+                gs->gauntletMove=idx;
+                runTurn(gs);
+                gs->screen=SCREEN_GAUNTLET_RESOLVE;
+            }
+            break;
+        }
+
+        case SCREEN_GAUNTLET_RESOLVE:
+            if (pressed(in,BTN_ENTER)||pressed(in,BTN_SPACE)) {
+                int playerDead=(gs->p1.hp<=0) && (!gs->coop || gs->p2.hp<=0);
+                int allDead=allEnemiesDead(gs);
+
+                if (playerDead && gs->endless) {
+                    snprintf(gs->resultMsg,128,"You fell in wave %d after %d kills.", gs->wave, endlessKills(gs));
+                    gs->screen=SCREEN_RESULT;
+                } else if (playerDead) {
+                    snprintf(gs->resultMsg,128,"%s", gs->coop ? "Both champions fell... the Gauntlet wins."
+                                                              : "You fell... the Gauntlet wins.");
+                    gs->screen=SCREEN_RESULT;
+                } else if (gs->endless) {
+                    /* no turn limit: survive as long as you can */
+                    gs->turn++;
+                    gs->selectedMove=0;
+                    logClear(&gs->log);
+                    if (endlessRefill(gs)) {
+                        char buf[128];
+                        snprintf(buf,128,"WAVE %d: %d enemies. +%d HP",gs->wave,endlessWaveSize(gs->wave),ENDLESS_WAVE_HEAL);
+                        logAdd(&gs->log, buf);
+                    }
+                    int f=firstAliveEnemy(gs);
+                    if(f>=0 && gs->enemies[gs->selectedTarget].hp<=0) gs->selectedTarget=f;
+                    gs->screen=SCREEN_GAUNTLET_BATTLE;
+                } else if (allDead) {
+                    snprintf(gs->resultMsg,128,"%s", gs->coop ? "GAUNTLET CLEARED! The champions stand together!"
+                                                              : "GAUNTLET CLEARED! Champion stands alone!");
+                    gs->screen=SCREEN_RESULT;
+                } else if (gs->turn >= MAX_TURNS) {
+                    snprintf(gs->resultMsg,128,"Time expired. The Gauntlet is unfinished.");
+                    gs->screen=SCREEN_RESULT;
+                } else {
+                    gs->turn++;
+                    gs->selectedMove=0;
+                    int f=firstAliveEnemy(gs);
+                    if(f>=0 && gs->enemies[gs->selectedTarget].hp<=0) gs->selectedTarget=f;
+                    logClear(&gs->log);
+                    gs->screen=SCREEN_GAUNTLET_BATTLE;
+                    if (gs->coop) {
+                        gs->selectedMove2=0;
+                        if(f>=0 && gs->enemies[gs->selectedTarget2].hp<=0) gs->selectedTarget2=f;
+                        coopNewTurn(gs);
+                        coopTryTurn(gs);
+                    }
+                }
+            }
+            break;
+
+        case SCREEN_RESULT:
+            if (pressed(in,BTN_1) && gs->coop != 2) {   /* a networked rematch needs a new link */
+                char name1[32]; int c1=gs->p1.classId;
+                strncpy(name1, gs->p1.name, 31); name1[31]='\0';
+                char name2[32]; int c2=gs->p2.classId;
+                strncpy(name2, gs->p2.name, 31); name2[31]='\0';
+                int wasGauntlet = gs->gauntletMode;
+                if (wasGauntlet) {
+                    initFighter(&gs->p1, name1, c1);
+                    if (gs->vsComputer==4) initFighter(&gs->p2, name2, c2);
+                    initGauntlet(gs);
+                    if (gs->vsComputer==3) endlessStart(gs);
+                    if (gs->vsComputer==4) coopStart(gs, 1, 0);
+                    gs->screen=SCREEN_GAUNTLET_BATTLE;
+                } else {
+                    initFighter(&gs->p1, name1, c1);
+                    initFighter(&gs->p2, name2, c2);
+                    gs->turn=1; gs->selectedMove=0; gs->p1chosen=0;
+                    logClear(&gs->log);
+                    gs->screen=SCREEN_BATTLE;
+                }
+            }
+            if (pressed(in,BTN_2)) { BalVersion *bal=gs->bal; memset(gs,0,sizeof(*gs)); gs->bal=bal; gs->screen=SCREEN_MENU; }
+            if (pressed(in,BTN_3)) gs->postChoice=3;
+            break;
+    }
+
+    /* Match boundaries are screen transitions, counted in one place */
+    if (gs->screen != prevScreen) {
+        stateChanged(gs);
+        if ((gs->screen==SCREEN_BATTLE && prevScreen!=SCREEN_RESOLVE) ||
+            (gs->screen==SCREEN_GAUNTLET_BATTLE && prevScreen!=SCREEN_GAUNTLET_RESOLVE))
+            metricsAdd(&gMetrics.matchesStarted);
+        if (gs->screen==SCREEN_RESULT) {
+            metricsAdd(&gMetrics.matchesFinished);
+            clearSavedMatch();
+        }
+    }
+}
+
+/* ===================== SIMULATION THREAD ===================== */
+/*
+ * updateGame() runs on its own thread so a slow turn (AI search, solver
+ * lookups, the fsync in saveMatch) never costs a rendered frame.
+ *   render -> sim: InputFrames through a lock-free single-producer /
+ *                  single-consumer ring; a condvar doorbell only wakes the
+ *                  idle sim thread, it never guards the data.
+ *   sim -> render: whole GameState snapshots through a triple buffer. The sim
+ *                  thread fills its private back slot and swaps it into the
+ *                  middle; the renderer swaps the middle into its front slot
+ *                  when a fresh one is flagged. Neither side ever waits.
+ */
+#define INPUT_QUEUE_LEN 64   /* power of two */
+#define TB_FRESH        4u   /* flag bit on TripleBuffer.middle */
+
+typedef struct {
+    InputFrame   buf[INPUT_QUEUE_LEN];
+    atomic_uint  head;       /* next slot the producer writes */
+    atomic_uint  tail;       /* next slot the consumer reads  */
+} InputQueue;
+
+int iqPush(InputQueue *q, const InputFrame *f) {
+    unsigned h = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned t = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (h - t == INPUT_QUEUE_LEN) return 0;   /* full: drop the frame */
+    q->buf[h & (INPUT_QUEUE_LEN-1)] = *f;
+    atomic_store_explicit(&q->head, h+1, memory_order_release);
+    return 1;
+}
+
+int iqPop(InputQueue *q, InputFrame *f) {
+    unsigned t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned h = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (t == h) return 0;
+    *f = q->buf[t & (INPUT_QUEUE_LEN-1)];
+    atomic_store_explicit(&q->tail, t+1, memory_order_release);
+    return 1;
+}
+
+unsigned iqDepth(InputQueue *q) {
+    return atomic_load_explicit(&q->head, memory_order_relaxed) -
+           atomic_load_explicit(&q->tail, memory_order_relaxed);
+}
+
+typedef struct {
+    GameState    slot[3];
+    atomic_uint  middle;     /* slot index, | TB_FRESH when not yet read */
+    unsigned     back;       /* owned by the writer */
+    unsigned     front;      /* owned by the reader */
+} TripleBuffer;
+
+void tbInit(TripleBuffer *tb, const GameState *init) {
+    for (int i=0;i<3;i++) tb->slot[i] = *init;
+    tb->back = 0; tb->front = 2;
+    atomic_init(&tb->middle, 1u);
+}
+
+void tbPublish(TripleBuffer *tb, const GameState *gs) {
+    tb->slot[tb->back] = *gs;
+    tb->back = atomic_exchange_explicit(&tb->middle, tb->back | TB_FRESH, memory_order_acq_rel) & 3u;
+}
+
+/* Latest published state; stays valid until the next tbLatest() call */
+GameState *tbLatest(TripleBuffer *tb) {
+    if (atomic_load_explicit(&tb->middle, memory_order_relaxed) & TB_FRESH)
+        tb->front = atomic_exchange_explicit(&tb->middle, tb->front, memory_order_acq_rel) & 3u;
+    return &tb->slot[tb->front];
+}
+
+typedef struct {
+    GameState       live;    /* authoritative state, sim thread only */
+    uint32_t        rng;     /* seed for the sim thread's generator */
+    InputQueue      input;
+    TripleBuffer    view;
+    atomic_int      quit;
+    pthread_mutex_t bellLock;
+    pthread_cond_t  bell;
+    int             rung;
+    pthread_t       thread;
+    CoopLink       *link;    /* networked co-op: told about every new state */
+} SimThread;
+
+void *simThreadMain(void *arg) {
+    SimThread *st = arg;
+    gRng = st->rng;
+    for (;;) {
+        pthread_mutex_lock(&st->bellLock);
+        while (!st->rung && !atomic_load(&st->quit))
+            pthread_cond_wait(&st->bell, &st->bellLock);
+        st->rung = 0;
+        pthread_mutex_unlock(&st->bellLock);
+        if (atomic_load(&st->quit)) break;
+
+        atomic_store_explicit(&gMetrics.queueDepth, iqDepth(&st->input), memory_order_relaxed);
+        InputFrame in;
+        int changed = enginePoll(&gEngine, &st->live) | balPoll(&gBalPatch, &st->live);
+        while (iqPop(&st->input, &in)) {
+            updateGame(&st->live, &in);
+            if (st->link) coopSend(st->link, &st->live);
+            changed = 1;
+        }
+        if (changed) tbPublish(&st->view, &st->live);
+    }
+    return NULL;
+}
+
+void simStart(SimThread *st, const GameState *init, CoopLink *link) {
+    memset(st, 0, sizeof(*st));
+    st->live = *init;
+    st->rng  = gRng;
+    st->link = link;
+    tbInit(&st->view, init);
+    pthread_mutex_init(&st->bellLock, NULL);
+    pthread_cond_init(&st->bell, NULL);
+    pthread_create(&st->thread, NULL, simThreadMain, st);
+}
+
+void simRing(SimThread *st) {
+    pthread_mutex_lock(&st->bellLock);
+    st->rung = 1;
+    pthread_cond_signal(&st->bell);
+    pthread_mutex_unlock(&st->bellLock);
+}
+
+void simSend(SimThread *st, const InputFrame *in) {
+    if (iqPush(&st->input, in)) simRing(st);
+}
+
+void simStop(SimThread *st) {
+    atomic_store(&st->quit, 1);
+    simRing(st);
+    pthread_join(st->thread, NULL);
+    pthread_cond_destroy(&st->bell);
+    pthread_mutex_destroy(&st->bellLock);
+}
+
+/* ===================== DUEL SOLVER ===================== */
+/*
+ * --solve A,B works out the best play for player 1 (class A) against the
+ * computer (class B, on the active AI policy) for a duel cut off after
+ * --solve-turns turns (decided on HP like the MAX_TURNS timeout). Positions
+ * grow about 5x per turn - ~0.7M by turn 6, ~19M by turn 8 - so the full
+ * 25 turns is out of reach of an in-memory solve.
+ *
+ * Layer t holds every position that can start turn t. A forward sweep expands
+ * each one under every affordable P1 move, every AI reply with non-zero odds
+ * and every chance path (ChanceTrace) to build layer t+1; a backward sweep
+ * then scores each position as its best expected result (win 1, draw 1/2,
+ * loss 0). Positions are packed into 64-bit keys and no edges are stored:
+ * children are re-derived by running the turn again when they are needed.
+ *
+ * Each sweep runs a layer on --threads workers (default one per CPU), each
+ * taking a fixed slice of it. Turn t only reads layer t+1, which nobody
+ * writes during the sweep, so the lookups take no locks. Expanding workers
+ * collect children in their own sets, merged in slice order afterwards, so
+ * every layer comes out in the same order as a single-threaded run. A layer's
+ * per-position arrays are allocated once its keys are known and first touched
+ * by the worker that owns the slice, which keeps them on that worker's NUMA
+ * node for every later sweep.
+ */
+#define SOLVE_MIN_CAP     1024
+#define SOLVE_MAX_THREADS 64
+#define SOLVE_MIN_SLICE   256    /* positions per worker below which fewer workers run */
+
+int gSolveThreads;   /* --threads; 0 = one per CPU */
+
+typedef struct {
+    uint64_t *keys;
+    uint32_t *slots;       /* open addressing, index+1 (0 = empty) */
+    uint32_t  count, cap;
+    double   *value;       /* best expected result from here; arrays from here on */
+    double   *alt;         /* expected result under a policy being evaluated */
+    float   (*q)[5];       /* expected result per P1 move; unaffordable = ATK's */
+    double   *reach;       /* chance that optimal play passes through here */
+    uint64_t *local;       /* BAL_ parameters this position's own turn reads */
+    uint64_t *dep;         /* ...and everything below it reads */
+} SolveLayer;
+
+typedef struct {
+    Fighter         base[2];   /* class templates; the key overwrites the rest */
+    const AiPolicy *ai;
+    int             turns;     /* horizon, <= MAX_TURNS */
+    SolveLayer      layer[MAX_TURNS+2];
+    size_t          positions;
+    int             threads;
+} Solver;
+
+/* 23 bits a side. At the start of a turn buff and DoT timers are <= 2 and
+ * knight sunders come in steps of 2 up to MAX_SUNDER. */
+static uint64_t solvePackSide(const Fighter *f) {
+    return (uint64_t)f->hp | (uint64_t)f->charge<<8 | (uint64_t)f->buffTurns<<12
+         | (uint64_t)(f->buffActive!=0)<<14 | (uint64_t)f->dotStacks<<15
+         | (uint64_t)f->dotTurns<<17 | (uint64_t)(f->defPenalty/2)<<19;
+}
+
+static void solveUnpackSide(Fighter *f, const Fighter *base, uint32_t k) {
+    *f = *base;
+    f->hp         = k & 255;
+    f->charge     = k>>8 & 15;
+    f->buffTurns  = k>>12 & 3;
+    f->buffActive = k>>14 & 1;
+    f->dotStacks  = k>>15 & 3;
+    f->dotTurns   = k>>17 & 3;
+    f->defPenalty = (k>>19 & 15) * 2;
+}
+
+uint64_t solvePack(const Fighter *p1, const Fighter *p2) { return solvePackSide(p1) | solvePackSide(p2) << 23; }
+
+void solveUnpack(const Solver *S, uint64_t key, Fighter *p1, Fighter *p2) {
+    solveUnpackSide(p1, &S->base[0], (uint32_t)(key & 0x7fffff));
+    solveUnpackSide(p2, &S->base[1], (uint32_t)(key >> 23));
+}
+
+static uint32_t solveHash(uint64_t k) { k ^= k>>33; k *= 0xff51afd7ed558ccdull; k ^= k>>33; return (uint32_t)k; }
+
+/* Per-position arrays sized to cap; malloc leaves the pages untouched */
+static void layerAlloc(SolveLayer *L) {
+    L->value = realloc(L->value, (size_t)L->cap * sizeof(double));
+    L->alt   = realloc(L->alt,   (size_t)L->cap * sizeof(double));
+    L->q     = realloc(L->q,     (size_t)L->cap * sizeof(*L->q));
+    L->reach = realloc(L->reach, (size_t)L->cap * sizeof(double));
+    L->local = realloc(L->local, (size_t)L->cap * sizeof(uint64_t));
+    L->dep   = realloc(L->dep,   (size_t)L->cap * sizeof(uint64_t));
+}
+
+static void layerGrow(SolveLayer *L) {
+    L->cap   = L->cap ? L->cap*2 : SOLVE_MIN_CAP;
+    L->keys  = realloc(L->keys,  (size_t)L->cap * sizeof(uint64_t));
+    if (L->value) layerAlloc(L);   /* a placed layer growing on a retune */
+    free(L->slots);
+    L->slots = calloc((size_t)L->cap*2, sizeof(uint32_t));
+    for (uint32_t i=0;i<L->count;i++) {
+        uint32_t h = solveHash(L->keys[i]) & (L->cap*2-1);
+        while (L->slots[h]) h = (h+1) & (L->cap*2-1);
+        L->slots[h] = i+1;
+    }
+}
+
+/* Index of key, adding it if insert is set; UINT32_MAX if absent */
+uint32_t layerFind(SolveLayer *L, uint64_t key, int insert) {
+    if (insert && L->count == L->cap) layerGrow(L);
+    if (!L->cap) return UINT32_MAX;
+    uint32_t mask = L->cap*2-1, h = solveHash(key) & mask;
+    for (; L->slots[h]; h = (h+1) & mask)
+        if (L->keys[L->slots[h]-1] == key) return L->slots[h]-1;
+    if (!insert) return UINT32_MAX;
+    if (L->value) {
+        L->reach[L->count] = 0;
+        L->local[L->count] = L->dep[L->count] = 0;
+    }
+    L->keys[L->count] = key;
+    L->slots[h] = ++L->count;
+    return L->count-1;
+}
+
+/* Empties L, keeping its storage */
+void layerClear(SolveLayer *L) {
+    if (L->cap) memset(L->slots, 0, (size_t)L->cap*2 * sizeof(uint32_t));
+    L->count = 0;
+}
+
+void layerFree(SolveLayer *L) {
+    free(L->keys); free(L->slots); free(L->value); free(L->alt); free(L->q); free(L->reach);
+    free(L->local); free(L->dep);
+    memset(L, 0, sizeof(*L));
+}
+
+enum { SOLVE_BUILD, SOLVE_VALUE, SOLVE_ALT, SOLVE_REACH };
+
+static _Thread_local uint64_t gSolveDeps;     /* dep masks of the children VALUE visited */
+static _Thread_local SolveLayer *gSolveKids;   /* where BUILD puts children, if not layer t+1 */
+
+/* One turn from (p1,p2) with P1 playing a, over every AI reply and chance
+ * path. BUILD adds the children to layer t+1; VALUE/ALT return the expected
+ * result from that layer's value/alt; REACH also passes reach down. */
+double solveMove(Solver *S, int mode, int t, const Fighter *p1, const Fighter *p2,
+                 int a, const double odds[5], double reach) {
+    SolveLayer *next = &S->layer[t+1];
+    ChanceTrace trace;
+    double ev = 0;
+    gChance = &trace;
+    for (int b=0;b<5;b++) {
+        if (odds[b] <= 0) continue;
+        trace.len = trace.pos = 0;
+        do {
+            Fighter x = *p1, y = *p2;
+            resolveTurn(&x, &y, a, b, NULL);
+            double p = odds[b] * chanceProb(&trace), v = 0;
+            int d1 = x.hp<=0, d2 = y.hp<=0;
+            if (d1 || d2)            v = (d1 && d2) ? 0.5 : d2;
+            else if (t == S->turns)  v = x.hp>y.hp ? 1 : x.hp<y.hp ? 0 : 0.5;
+            else if (mode == SOLVE_BUILD) layerFind(gSolveKids ? gSolveKids : next, solvePack(&x,&y), 1);
+            else {
+                uint32_t i = layerFind(next, solvePack(&x,&y), 0);
+                v = (mode == SOLVE_ALT) ? next->alt[i] : next->value[i];
+                if (mode == SOLVE_VALUE) gSolveDeps |= next->dep[i];
+                if (mode == SOLVE_REACH) next->reach[i] += reach*p;
+            }
+            ev += p*v;
+        } while (chanceNext(&trace));
+    }
+    gChance = NULL;
+    return ev;
+}
+
+static int solveAffordable(const Fighter *f, int move) { return getMoves(f->classId)[move].cost <= f->charge; }
+
+void solverFree(Solver *S) {
+    for (int t=0;t<MAX_TURNS+2;t++) layerFree(&S->layer[t]);
+}
+
+static void solveExpand(Solver *S, int t, uint32_t i) {
+    Fighter p1, p2;
+    double odds[5];
+    solveUnpack(S, S->layer[t].keys[i], &p1, &p2);
+    aiPolicyOdds(S->ai, &p2, &p1, odds);
+    for (int a=0;a<5;a++)
+        if (solveAffordable(&p1, a)) solveMove(S, SOLVE_BUILD, t, &p1, &p2, a, odds, 0);
+}
+
+/* Scores one position from layer t+1's values and records what it read */
+static void solveScore(Solver *S, int t, uint32_t i) {
+    SolveLayer *L = &S->layer[t];
+    Fighter p1, p2;
+    double odds[5], best = -1;
+    solveUnpack(S, L->keys[i], &p1, &p2);
+    aiPolicyOdds(S->ai, &p2, &p1, odds);
+    gBalReads = gSolveDeps = 0;
+    for (int a=0;a<5;a++) {
+        double q = solveAffordable(&p1, a) ? solveMove(S, SOLVE_VALUE, t, &p1, &p2, a, odds, 0) : L->q[i][MOVE_ATK];
+        L->q[i][a] = (float)q;
+        if (q > best) best = q;
+    }
+    L->value[i] = best;
+    L->local[i] = gBalReads;
+    L->dep[i]   = gBalReads | gSolveDeps;
+}
+
+typedef void (*SolvePolicy)(const Fighter *p1, const Fighter *p2, int turn, const void *ctx, double prob[5]);
+
+/* One worker's share of a layer sweep */
+typedef struct SolveSlice {
+    Solver        *S;
+    int            t;
+    uint32_t       lo, hi;
+    void         (*fn)(struct SolveSlice *);
+    const Balance *bal;       /* gBal is per thread */
+    uint64_t       changed;   /* retune: only positions that read these... */
+    uint32_t       fresh;     /* ...or were added by it (index >= fresh); changed 0 = all */
+    SolvePolicy    policy;    /* evaluate */
+    const void    *ctx;
+    SolveLayer     kids;      /* expand: children, in the order found */
+    size_t         done;
+} SolveSlice;
+
+static int solveSliceWants(const SolveSlice *s, uint32_t i, const uint64_t *mask) {
+    return !s->changed || i >= s->fresh || (mask[i] & s->changed);
+}
+
+static void sliceExpand(SolveSlice *s) {
+    const SolveLayer *L = &s->S->layer[s->t];
+    gSolveKids = &s->kids;
+    for (uint32_t i=s->lo;i<s->hi;i++)
+        if (solveSliceWants(s, i, L->local)) solveExpand(s->S, s->t, i);
+    gSolveKids = NULL;
+}
+
+/* First touch of the per-position arrays */
+static void slicePlace(SolveSlice *s) {
+    SolveLayer *L = &s->S->layer[s->t];
+    size_t n = s->hi - s->lo;
+    memset(L->value + s->lo, 0, n * sizeof(double));
+    memset(L->alt   + s->lo, 0, n * sizeof(double));
+    memset(L->q     + s->lo, 0, n * sizeof(*L->q));
+    memset(L->reach + s->lo, 0, n * sizeof(double));
+    memset(L->local + s->lo, 0, n * sizeof(uint64_t));
+    memset(L->dep   + s->lo, 0, n * sizeof(uint64_t));
+}
+
+static void sliceScore(SolveSlice *s) {
+    const SolveLayer *L = &s->S->layer[s->t];
+    for (uint32_t i=s->lo;i<s->hi;i++)
+        if (solveSliceWants(s, i, L->dep)) { solveScore(s->S, s->t, i); s->done++; }
+}
+
+static void sliceEvaluate(SolveSlice *s) {
+    SolveLayer *L = &s->S->layer[s->t];
+    Fighter p1, p2;
+    double odds[5], prob[5];
+    for (uint32_t i=s->lo;i<s->hi;i++) {
+        solveUnpack(s->S, L->keys[i], &p1, &p2);
+        aiPolicyOdds(s->S->ai, &p2, &p1, odds);
+        s->policy(&p1, &p2, s->t, s->ctx, prob);
+        double v = 0, atkP = 0;
+        for (int a=0;a<5;a++) if (prob[a] > 0 && !solveAffordable(&p1, a)) { atkP += prob[a]; prob[a] = 0; }
+        prob[MOVE_ATK] += atkP;
+        for (int a=0;a<5;a++)
+            if (prob[a] > 0) v += prob[a] * solveMove(s->S, SOLVE_ALT, s->t, &p1, &p2, a, odds, 0);
+        L->alt[i] = v;
+    }
+}
+
+static void *solveSliceMain(void *arg) {
+    SolveSlice *s = arg;
+    gBal = s->bal;
+    s->fn(s);
+    return NULL;
+}
+
+/* Runs job->fn over layer t in fixed slices, the caller taking the first.
+ * Expand slices' children are then added to layer t+1 in slice order.
+ * Returns the slices' summed done count. */
+static size_t solveSweep(Solver *S, int t, void (*fn)(SolveSlice *), const SolveSlice *job) {
+    static SolveSlice slice[SOLVE_MAX_THREADS];
+    pthread_t tid[SOLVE_MAX_THREADS];
+    uint32_t count = S->layer[t].count;
+    int n = (int)(count / SOLVE_MIN_SLICE);
+    if (n > S->threads) n = S->threads;
+    if (n < 1) n = 1;
+    for (int k=0;k<n;k++) {
+        SolveSlice *s = &slice[k];
+        *s = job ? *job : (SolveSlice){0};
+        s->S = S; s->t = t; s->fn = fn; s->bal = gBal;
+        s->lo = (uint32_t)((uint64_t)count * k / n);
+        s->hi = (uint32_t)((uint64_t)count * (k+1) / n);
+    }
+    for (int k=1;k<n;k++) pthread_create(&tid[k], NULL, solveSliceMain, &slice[k]);
+    fn(&slice[0]);
+    for (int k=1;k<n;k++) pthread_join(tid[k], NULL);
+
+    size_t done = 0;
+    for (int k=0;k<n;k++) {
+        SolveSlice *s = &slice[k];
+        for (uint32_t i=0;i<s->kids.count;i++) layerFind(&S->layer[t+1], s->kids.keys[i], 1);
+        layerFree(&s->kids);
+        done += s->done;
+    }
+    return done;
+}
+
+static void solvePlace(Solver *S, int t) {
+    SolveLayer *L = &S->layer[t];
+    if (L->value || !L->cap) return;
+    layerAlloc(L);
+    solveSweep(S, t, slicePlace, NULL);
+}
+
+void solverRun(Solver *S, int classA, int classB, int turns) {
+    memset(S, 0, sizeof(*S));
+    S->turns = turns < 1 ? 1 : turns > MAX_TURNS ? MAX_TURNS : turns;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    S->threads = gSolveThreads > 0 ? gSolveThreads : cpus > 0 ? (int)cpus : 1;
+    if (S->threads > SOLVE_MAX_THREADS) S->threads = SOLVE_MAX_THREADS;
+    initFighter(&S->base[0], "P1", classA);
+    initFighter(&S->base[1], "P2", classB);
+    S->ai = aiActive();
+    layerFind(&S->layer[1], solvePack(&S->base[0], &S->base[1]), 1);
+
+    for (int t=1;t<S->turns;t++) solveSweep(S, t, sliceExpand, NULL);
+    for (int t=S->turns;t>=1;t--) {
+        solvePlace(S, t);
+        solveSweep(S, t, sliceScore, NULL);
+    }
+    for (int t=1;t<=S->turns;t++) S->positions += S->layer[t].count;
+
+    /* Where optimal play actually goes: weights for the distillation. Kept on
+     * one thread: children's reach is summed from many parents. */
+    Fighter p1, p2;
+    double odds[5];
+    S->layer[1].reach[0] = 1.0;
+    for (int t=1;t<S->turns;t++) {
+        SolveLayer *L = &S->layer[t];
+        for (uint32_t i=0;i<L->count;i++) {
+            if (L->reach[i] <= 0) continue;
+            solveUnpack(S, L->keys[i], &p1, &p2);
+            aiPolicyOdds(S->ai, &p2, &p1, odds);
+            int best = 0;
+            for (int a=1;a<5;a++) if (L->q[i][a] > L->q[i][best]) best = a;
+            solveMove(S, SOLVE_REACH, t, &p1, &p2, best, odds, L->reach[i]);
+        }
+    }
+}
+
+/* Re-solves after the parameters in changed (a BAL_ bit mask) were edited in
+ * gBal. Only positions whose own turn read one of them are re-expanded (new
+ * children get added), and only positions whose subtree read one are
+ * re-scored. Class stats are baked into every position, so those start over.
+ * Returns how many were re-scored; reach is left stale. */
+size_t solverRetune(Solver *S, uint64_t changed) {
+    if (changed & BAL_STAT_MASK) {
+        int a = S->base[0].classId, b = S->base[1].classId, turns = S->turns;
+        solverFree(S);
+        solverRun(S, a, b, turns);
+        return S->positions;
+    }
+    uint32_t old[MAX_TURNS+2];
+    for (int t=1;t<=S->turns;t++) old[t] = S->layer[t].count;
+
+    SolveSlice job = { .changed = changed };
+    for (int t=1;t<S->turns;t++) {
+        job.fresh = old[t];
+        solveSweep(S, t, sliceExpand, &job);
+    }
+    size_t rescored = 0;
+    for (int t=S->turns;t>=1;t--) {
+        job.fresh = old[t];
+        rescored += solveSweep(S, t, sliceScore, &job);
+    }
+    S->positions = 0;
+    for (int t=1;t<=S->turns;t++) S->positions += S->layer[t].count;
+    return rescored;
+}
+
+/* Exact expected result when P1 follows policy (a move distribution per
+ * position) instead of playing optimally. Fills every layer's alt. */
+double solverEvaluate(Solver *S, SolvePolicy policy, const void *ctx) {
+    SolveSlice job = { .policy = policy, .ctx = ctx };
+    for (int t=S->turns;t>=1;t--) solveSweep(S, t, sliceEvaluate, &job);
+    return S->layer[1].alt[0];
+}
+
+/* ===================== POLICY DISTILLATION ===================== */
+/*
+ * The solver's answer is one move per reachable position - far too big to
+ * ship. distilTree fits a depth-limited decision tree over a few features to
+ * it, choosing splits by value rather than by label: a leaf plays the move
+ * with the best reach-weighted expected result over its positions, and a
+ * split is kept only if it raises that total. The tree is then scored
+ * exactly with solverEvaluate and can be written out as plain C.
+ */
+enum { DF_HP, DF_OPP_HP, DF_CHARGE, DF_OPP_CHARGE, DF_BUFF, DF_OPP_BUFF, DF_DOT, DF_OPP_DOT, DF_TURN, DF_COUNT };
+
+static const char *DF_EXPR[DF_COUNT] = {
+    "me->hp*100/me->maxHp", "opp->hp*100/opp->maxHp", "me->charge", "opp->charge",
+    "me->buffTurns", "opp->buffTurns", "me->dotStacks", "opp->dotStacks", "turn",
+};
+static const char *MOVE_ENUM[5] = { "MOVE_ATK", "MOVE_DEF", "MOVE_DOT", "MOVE_BUFF", "MOVE_ULT" };
+
+#define DIST_MAX_DEPTH 12
+#define DIST_MAX_NODES (2 << DIST_MAX_DEPTH)
+
+typedef struct {
+    int8_t  feature;     /* -1: leaf */
+    uint8_t threshold;   /* go left when feature <= threshold */
+    uint8_t move;        /* leaf move */
+    int16_t left, right;
+} DistNode;
+
+typedef struct {
+    DistNode nodes[DIST_MAX_NODES];
+    int      count, depth;
+} DistTree;
+
+static uint8_t distClamp(int v) { return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v); }
+
+void distFeatures(const Fighter *me, const Fighter *opp, int turn, uint8_t f[DF_COUNT]) {
+    f[DF_HP]         = distClamp(me->hp*100/me->maxHp);
+    f[DF_OPP_HP]     = distClamp(opp->hp*100/opp->maxHp);
+    f[DF_CHARGE]     = (uint8_t)me->charge;
+    f[DF_OPP_CHARGE] = (uint8_t)opp->charge;
+    f[DF_BUFF]       = (uint8_t)me->buffTurns;
+    f[DF_OPP_BUFF]   = (uint8_t)opp->buffTurns;
+    f[DF_DOT]        = (uint8_t)me->dotStacks;
+    f[DF_OPP_DOT]    = (uint8_t)opp->dotStacks;
+    f[DF_TURN]       = (uint8_t)turn;
+}
+
+int distMove(const DistTree *tree, const uint8_t f[DF_COUNT]) {
+    const DistNode *n = &tree->nodes[0];
+    while (n->feature >= 0) n = &tree->nodes[f[n->feature] <= n->threshold ? n->left : n->right];
+    return n->move;
+}
+
+typedef struct {
+    uint8_t (*feat)[DF_COUNT];
+    float   (*wq)[5];     /* reach * q */
+    uint32_t *idx;
+    size_t    count;
+} DistSamples;
+
+static int distBest(const double tot[5], double *score) {
+    int best = 0;
+    for (int a=1;a<5;a++) if (tot[a] > tot[best]) best = a;
+    *score = tot[best];
+    return best;
+}
+
+static int distBuild(DistTree *tree, DistSamples *ds, uint32_t *idx, size_t n, int depth) {
+    int id = tree->count++;
+    DistNode *node = &tree->nodes[id];
+    double tot[5] = {0}, leafScore;
+    for (size_t i=0;i<n;i++) for (int a=0;a<5;a++) tot[a] += ds->wq[idx[i]][a];
+    node->feature = -1;
+    node->move    = (uint8_t)distBest(tot, &leafScore);
+    if (depth == tree->depth || n < 2) return id;
+
+    static _Thread_local double hist[256][5];   /* consumed before recursing */
+    int bestF = -1, bestT = 0;
+    double bestScore = leafScore + 1e-12 * (leafScore > 0 ? leafScore : 1);
+    for (int f=0;f<DF_COUNT;f++) {
+        memset(hist, 0, sizeof(hist));
+        int lo = 255, hi = 0;
+        for (size_t i=0;i<n;i++) {
+            int v = ds->feat[idx[i]][f];
+            if (v < lo) lo = v;
+            if (v > hi) hi = v;
+            for (int a=0;a<5;a++) hist[v][a] += ds->wq[idx[i]][a];
+        }
+        double left[5] = {0};
+        for (int v=lo; v<hi; v++) {
+            double right[5], sl, sr;
+            for (int a=0;a<5;a++) { left[a] += hist[v][a]; right[a] = tot[a] - left[a]; }
+            distBest(left, &sl); distBest(right, &sr);
+            if (sl + sr > bestScore) { bestScore = sl + sr; bestF = f; bestT = v; }
+        }
+    }
+    if (bestF < 0) return id;
+
+    size_t m = 0;
+    for (size_t i=0;i<n;i++)
+        if (ds->feat[idx[i]][bestF] <= bestT) { uint32_t tmp = idx[m]; idx[m++] = idx[i]; idx[i] = tmp; }
+    int l = distBuild(tree, ds, idx, m, depth+1);
+    int r = distBuild(tree, ds, idx+m, n-m, depth+1);
+    node = &tree->nodes[id];
+    if (tree->nodes[l].feature < 0 && tree->nodes[r].feature < 0 && tree->nodes[l].move == tree->nodes[r].move) {
+        tree->count = id+1;   /* both halves agree: keep the leaf */
+        return id;
+    }
+    node->feature = (int8_t)bestF; node->threshold = (uint8_t)bestT;
+    node->left = (int16_t)l; node->right = (int16_t)r;
+    return id;
+}
+
+void distilTree(DistTree *tree, Solver *S, int depth) {
+    DistSamples ds = {0};
+    for (int t=1;t<=S->turns;t++)
+        for (uint32_t i=0;i<S->layer[t].count;i++) ds.count += S->layer[t].reach[i] > 0;
+    ds.feat = malloc(ds.count * sizeof(*ds.feat));
+    ds.wq   = malloc(ds.count * sizeof(*ds.wq));
+    ds.idx  = malloc(ds.count * sizeof(uint32_t));
+
+    size_t k = 0;
+    Fighter p1, p2;
+    for (int t=1;t<=S->turns;t++) {
+        SolveLayer *L = &S->layer[t];
+        for (uint32_t i=0;i<L->count;i++) {
+            if (L->reach[i] <= 0) continue;
+            solveUnpack(S, L->keys[i], &p1, &p2);
+            distFeatures(&p1, &p2, t, ds.feat[k]);
+            for (int a=0;a<5;a++) ds.wq[k][a] = (float)(L->reach[i] * L->q[i][a]);
+            ds.idx[k] = (uint32_t)k;
+            k++;
+        }
+    }
+    tree->count = 0;
+    tree->depth = depth < 1 ? 1 : depth > DIST_MAX_DEPTH ? DIST_MAX_DEPTH : depth;
+    distBuild(tree, &ds, ds.idx, ds.count, 0);
+    free(ds.feat); free(ds.wq); free(ds.idx);
+}
+
+static void distTreePolicy(const Fighter *p1, const Fighter *p2, int turn, const void *ctx, double prob[5]) {
+    uint8_t f[DF_COUNT];
+    distFeatures(p1, p2, turn, f);
+    memset(prob, 0, 5*sizeof(double));
+    prob[distMove(ctx, f)] = 1.0;
+}
+
+static void distAiPolicy(const Fighter *p1, const Fighter *p2, int turn, const void *ctx, double prob[5]) {
+    (void)turn;
+    aiPolicyOdds(ctx, p1, p2, prob);
+}
+
+static void distEmitNode(FILE *f, const DistTree *tree, int id, int indent) {
+    const DistNode *n = &tree->nodes[id];
+    if (n->feature < 0) { fprintf(f, "%*sreturn %s;\n", indent, "", MOVE_ENUM[n->move]); return; }
+    fprintf(f, "%*sif (%s <= %d) {\n", indent, "", DF_EXPR[n->feature], n->threshold);
+    distEmitNode(f, tree, n->left, indent+4);
+    fprintf(f, "%*s} else {\n", indent, "");
+    distEmitNode(f, tree, n->right, indent+4);
+    fprintf(f, "%*s}\n", indent, "");
+}
+
+void distEmitC(FILE *f, const DistTree *tree, const char *fn, const char *note) {
+    int uses = 0;   /* 1: me, 2: opp, 4: turn */
+    for (int i=0;i<tree->count;i++) {
+        int ft = tree->nodes[i].feature;
+        if (ft >= 0) uses |= ft == DF_TURN ? 4 : (ft == DF_OPP_HP || ft == DF_OPP_CHARGE || ft == DF_OPP_BUFF || ft == DF_OPP_DOT) ? 2 : 1;
+    }
+    fprintf(f, "/* %s\n * A move the fighter can't pay for means MOVE_ATK. */\n"
+               "int %s(const Fighter *me, const Fighter *opp, int turn) {\n", note, fn);
+    if (uses != 7) fprintf(f, "   %s%s%s\n", uses & 1 ? "" : " (void)me;", uses & 2 ? "" : " (void)opp;", uses & 4 ? "" : " (void)turn;");
+    distEmitNode(f, tree, 0, 4);
+    fprintf(f, "}\n");
+}
+
+static const char *CLASS_KEY[3] = { "knight", "magician", "alchemist" };
+
+/* Reads NAME=VALUE lines (BAL_NAME) from stdin and re-solves after each */
+static void solveRetuneLoop(Solver *S) {
+    static Balance tuned;
+    tuned = *gBal;
+    gBal  = &tuned;
+    printf("retune: one NAME=VALUE per line, e.g. DOT_BASE[2]=14\n");
+    char line[128], name[64];
+    int v;
+    while (fgets(line, sizeof(line), stdin)) {
+        if (sscanf(line, " %63[^= \t] = %d", name, &v) != 2) continue;
+        int id = balFind(name);
+        if (id < 0) {
+            printf("unknown parameter; one of:");
+            for (int i=0;i<BAL_COUNT;i++) printf(" %s", BAL_NAME[i]);
+            printf("\n");
+            continue;
+        }
+        const char *bad = balRange(id, v);
+        if (bad) {   /* checked before the write: tuned is what gBal reads */
+            printf("%s %s; kept %d\n", name, bad, tuned.v[id]);
+            continue;
+        }
+        int was = tuned.v[id];
+        double before = S->layer[1].value[0];
+        size_t had = S->positions;
+        uint64_t t0 = nowNs();
+        tuned.v[id] = v;
+        size_t n = solverRetune(S, 1ull << id);
+        printf("%s %d -> %d: expected %.4f -> %.4f  (re-scored %zu of %zu positions, %zu new, %.2fs)\n",
+               name, was, v, before, S->layer[1].value[0], n, S->positions, S->positions - had, (nowNs()-t0)*1e-9);
+        fflush(stdout);
+    }
+    gBal = &BALANCE_DEFAULT;
+}
+
+/* --solve A,B [--solve-turns N] [--tree-depth N] [--emit FILE] [--retune] [--threads N] */
+int solveMain(const char *matchup, int turns, int depth, const char *emitPath, int retune) {
+    int ca = -1, cb = -1;
+    char a[32] = {0}, b[32] = {0};
+    if (sscanf(matchup, "%31[a-z],%31[a-z]", a, b) == 2)
+        for (int c=0;c<3;c++) {
+            if (!strcmp(a, CLASS_KEY[c])) ca = c;
+            if (!strcmp(b, CLASS_KEY[c])) cb = c;
+        }
+    if (ca < 0 || cb < 0) { fprintf(stderr, "--solve wants CLASS,CLASS (knight/magician/alchemist)\n"); return 1; }
+
+    static Solver S;
+    uint64_t t0 = nowNs();
+    solverRun(&S, ca, cb, turns);
+    double vOpt = S.layer[1].value[0];
+    printf("%s vs %s, %d turns (AI: %s): %zu positions in %.1fs on %d thread%s\n", CLASS_KEY[ca], CLASS_KEY[cb], S.turns,
+           S.ai->name, S.positions, (nowNs()-t0)*1e-9, S.threads, S.threads == 1 ? "" : "s");
+
+    static DistTree tree;
+    distilTree(&tree, &S, depth);
+    double vTree = solverEvaluate(&S, distTreePolicy, &tree);
+    double vAi   = solverEvaluate(&S, distAiPolicy, S.ai);
+    printf("expected result  optimal %.4f   tree %.4f (depth %d, %d nodes, %zu bytes)   AI policy as P1 %.4f\n",
+           vOpt, vTree, tree.depth, tree.count, tree.count * sizeof(DistNode), vAi);
+    printf("tree loss vs optimal: %.2f points\n", (vOpt - vTree) * 100);
+
+    if (emitPath) {
+        FILE *f = fopen(emitPath, "w");
+        if (!f) { fprintf(stderr, "%s: cannot write\n", emitPath); solverFree(&S); return 1; }
+        char note[160], fn[64];
+        snprintf(note, sizeof(note), "%s vs %s over %d turns, depth %d: expected %.4f (optimal %.4f)",
+                 CLASS_KEY[ca], CLASS_KEY[cb], S.turns, tree.depth, vTree, vOpt);
+        snprintf(fn, sizeof(fn), "distilled_%s_vs_%s", CLASS_KEY[ca], CLASS_KEY[cb]);
+        distEmitC(f, &tree, fn, note);
+        fclose(f);
+    }
+    if (retune) solveRetuneLoop(&S);
+    solverFree(&S);
+    return 0;
+}
+
+/* ===================== BALANCE SENSITIVITY ===================== */
+/*
+ * --sensitivity N estimates d(P1 win rate)/d(parameter) for every Balance
+ * entry in every class matchup by central differences. Both variants of a
+ * parameter replay the same N seeds (common random numbers), so most of the
+ * game-to-game noise cancels in the difference. Both sides play the active
+ * AI policy over the full MAX_TURNS. Parameters are handed out to one worker
+ * per core; RNG and Balance are thread-local, so workers don't interact.
+ */
+#define SENS_MAX_THREADS 64
+
+/* One AI-vs-AI duel to the end: 1 P1 win, 1/2 draw, 0 loss. turns may be NULL. */
+double simulateDuel(int classA, int classB, uint32_t seed, int *turns) {
+    Fighter a, b;
+    seedRng(seed);
+    initFighter(&a, "A", classA);
+    initFighter(&b, "B", classB);
+    for (int t=1;;t++) {
+        int ma = chooseMoveAI(&a, &b), mb = chooseMoveAI(&b, &a);
+        resolveTurn(&a, &b, ma, mb, NULL);
+        if (turns) *turns = t;
+        int d1 = a.hp<=0, d2 = b.hp<=0;
+        if (d1 || d2)       return (d1 && d2) ? 0.5 : d2;
+        if (t == MAX_TURNS) return a.hp>b.hp ? 1 : a.hp<b.hp ? 0 : 0.5;
+    }
+}
+
+typedef struct {
+    int        games;
+    atomic_int next;                    /* next parameter to hand out */
+    int        lo[BAL_COUNT], hi[BAL_COUNT];
+    double     grad[BAL_COUNT][3][3];   /* win-rate points per unit */
+    double     se[BAL_COUNT][3][3];
+} SensJob;
+
+static void *sensWorker(void *arg) {
+    SensJob *job = arg;
+    Balance bal = BALANCE_DEFAULT;
+    gBal = &bal;
+    for (int p; (p = atomic_fetch_add(&job->next, 1)) < BAL_COUNT; ) {
+        double span = job->hi[p] - job->lo[p];
+        for (int a=0;a<3;a++)
+        for (int b=0;b<3;b++) {
+            double sum = 0, sumSq = 0;
+            for (int at=0; at<job->games; at+=DUEL_BATCH) {
+                int n = job->games - at < DUEL_BATCH ? job->games - at : DUEL_BATCH;
+                uint32_t seed[DUEL_BATCH];
+                double up[DUEL_BATCH], down[DUEL_BATCH];
+                for (int i=0;i<n;i++) seed[i] = 0x9E3779B9u * (uint32_t)(at+i+1);
+                bal.v[p] = job->hi[p]; simulateDuels(a, b, seed, n, up, NULL);
+                bal.v[p] = job->lo[p]; simulateDuels(a, b, seed, n, down, NULL);
+                for (int i=0;i<n;i++) { sum += up[i] - down[i]; sumSq += (up[i]-down[i])*(up[i]-down[i]); }
+            }
+            bal.v[p] = BALANCE_DEFAULT.v[p];
+            double n = job->games, mean = sum/n, var = sumSq/n - mean*mean;
+            job->grad[p][a][b] = mean / span * 100;
+            job->se[p][a][b]   = sqrt(var > 0 ? var/n : 0) / span * 100;
+        }
+    }
+    return NULL;
+}
+
+int sensitivityMain(int games, const char *csvPath) {
+    static SensJob job;
+    job.games = games > 0 ? games : 1;
+    atomic_init(&job.next, 0);
+    for (int p=0;p<BAL_COUNT;p++) {
+        int v = BALANCE_DEFAULT.v[p], h = v/20 > 1 ? v/20 : 1;   /* ~5% */
+        job.hi[p] = v + h;
+        job.lo[p] = v - h < 0 ? v : v - h;   /* one-sided at zero */
+    }
+    aiActive();   /* compile the policy before the workers share it */
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus < 1 ? 1 : cpus > SENS_MAX_THREADS ? SENS_MAX_THREADS : (int)cpus;
+    pthread_t tid[SENS_MAX_THREADS];
+    uint64_t t0 = nowNs();
+    for (int i=0;i<threads;i++) pthread_create(&tid[i], NULL, sensWorker, &job);
+    for (int i=0;i<threads;i++) pthread_join(tid[i], NULL);
+
+    static const char CLS[3] = { 'K', 'M', 'A' };
+    printf("d(P1 win %%)/d(parameter), per unit; %d CRN game pairs per cell, %d threads, %.1fs\n",
+           job.games, threads, (nowNs()-t0)*1e-9);
+    printf("%-20s %7s", "parameter", "range");
+    for (int a=0;a<3;a++) for (int b=0;b<3;b++) printf("    %cv%c", CLS[a], CLS[b]);
+    printf("  most moved\n");
+    for (int p=0;p<BAL_COUNT;p++) {
+        printf("%-20s %3d-%-3d", BAL_NAME[p], job.lo[p], job.hi[p]);
+        int ba = 0, bb = 0;
+        for (int a=0;a<3;a++) for (int b=0;b<3;b++) {
+            printf(" %+6.2f", job.grad[p][a][b]);
+            if (fabs(job.grad[p][a][b]) > fabs(job.grad[p][ba][bb])) { ba = a; bb = b; }
+        }
+        printf("  %cv%c\n", CLS[ba], CLS[bb]);
+    }
+
+    if (csvPath) {
+        FILE *f = fopen(csvPath, "w");
+        if (!f) { fprintf(stderr, "%s: cannot write\n", csvPath); return 1; }
+        fprintf(f, "parameter,lo,hi,p1,p2,dwin_pct_per_unit,stderr\n");
+        for (int p=0;p<BAL_COUNT;p++)
+            for (int a=0;a<3;a++) for (int b=0;b<3;b++)
+                fprintf(f, "%s,%d,%d,%s,%s,%.4f,%.4f\n", BAL_NAME[p], job.lo[p], job.hi[p],
+                        CLASS_KEY[a], CLASS_KEY[b], job.grad[p][a][b], job.se[p][a][b]);
+        fclose(f);
+    }
+    return 0;
+}
+
+/* ===================== MATCH LENGTH ===================== */
+/*
+ * --lengths works out exactly how AI-vs-AI duels end, turn by turn: the
+ * chance a match is over by KO on turn t and how the HP stands in the ones
+ * still going - i.e. what a turn limit of t would decide. One pass answers
+ * every limit up to the horizon.
+ *
+ * There are ~10M positions by turn 8 and ~100M a few turns later, but HP
+ * only feeds into a turn through the AI's HP bucket: damage doesn't depend on
+ * it. So the chain is kept as an HP plane of probability per "rest" (the
+ * solver key with both HPs cleared: charge, buff, DoT, sunder). The turn from
+ * a rest and a pair of HP buckets is worked out once into a kernel of (next
+ * rest, HP change, chance) edges, and a step shifts whole plane rows along
+ * each edge; what crosses 0 HP is absorbed as a KO. Transmutation sets HP
+ * rather than moving it, so those edges are replayed cell by cell on their
+ * chance path.
+ *
+ * A step runs twice over the edges: once to find which cells of the next
+ * layer get mass (so its rows are packed, not 256x256), once to move it.
+ * Cells left under the floor are dropped and counted; every figure is exact
+ * to within that mass.
+ *
+ * Duels only: there are no gauntlet timeout odds. A gauntlet position has
+ * four HP tracks and three enemies' charge and buff, and even with dead
+ * enemies dropped from the key (GAUNTLET ENUMERATION) a Knight run has
+ * ~235k positions on turn 4 with 1e-9 of mass floored, and a minute a turn.
+ * Lumping the champion's HP out the way this lumps both duel HPs still
+ * leaves the enemy product in the rest key. --gauntlet gives the exact
+ * cleared/fallen split per class for as many turns as it can reach, which
+ * is well short of MAX_TURNS.
+ */
+#define LEN_HORIZON 60
+#define LEN_HP_BITS (255ull | 255ull << 23)
 
+typedef struct {
+    uint64_t next;        /* rest after the turn */
+    double   p;
+    int16_t  d1, d2;      /* HP change (not for split edges) */
+    uint8_t  split, a, b, len;
+    uint32_t hits;        /* chance path, to replay split edges */
+} LenEdge;
+
+typedef struct {
+    uint8_t  lo1, hi1, lo2, hi2;       /* bounding box, row = P1 HP, column = P2 HP */
+    uint8_t  rowLo[256], rowHi[256];   /* occupied columns per row */
+    uint32_t row[256];                 /* where the row's rowLo cell is in the layer */
+} LenPlane;
+
+typedef struct {
+    SolveLayer rest;      /* rest key -> plane */
+    LenPlane  *plane;
+    uint32_t   planeCap;
+    float     *cell;
+    size_t     cellCount, cellCap;
+} LenLayer;
+
+typedef struct { uint32_t plane; uint8_t h1, h2; float m; } LenDrop;
+
+typedef struct {
+    Fighter         base[2];
+    const AiPolicy *ai;
+    uint8_t         bucket[2][256];   /* AI HP bucket by HP */
+    LenLayer        layer[2];         /* this turn and next */
+    SolveLayer      kernel;           /* rest + buckets -> edges */
+    uint32_t       *kStart, *kCount, kCap;
+    LenEdge        *edge;
+    size_t          edgeCount, edgeCap;
+    LenDrop        *drop;             /* split results waiting for their cells */
+    size_t          dropCount, dropCap;
+    float           floor;
+    int             turns;
+    double          ko[LEN_HORIZON+1][3];     /* ended on turn t: P1 KO win, P2 KO win, double KO */
+    double          lead[LEN_HORIZON+1][3];   /* going after turn t: P1 ahead, behind, level */
+    double          lost;                     /* mass dropped under the floor */
+    size_t          peakCells;
+} LenChain;
+
+static void lenUnpack(const LenChain *C, uint64_t key, Fighter *p1, Fighter *p2) {
+    solveUnpackSide(p1, &C->base[0], (uint32_t)(key & 0x7fffff));
+    solveUnpackSide(p2, &C->base[1], (uint32_t)(key >> 23));
+}
+
+/* Plane for rest in layer L, created empty if new */
+static uint32_t lenPlane(LenLayer *L, uint64_t rest) {
+    uint32_t had = L->rest.count, i = layerFind(&L->rest, rest, 1);
+    if (L->rest.count == had) return i;
+    if (i >= L->planeCap) {
+        L->planeCap = L->rest.cap;
+        L->plane = realloc(L->plane, L->planeCap * sizeof(LenPlane));
+    }
+    LenPlane *P = &L->plane[i];
+    P->lo1 = P->lo2 = 255;
+    P->hi1 = P->hi2 = 0;
+    memset(P->rowLo, 255, sizeof(P->rowLo));
+    memset(P->rowHi, 0, sizeof(P->rowHi));
+    return i;
+}
+
+/* Widens P to take row h1, columns c0..c1 */
+static void lenCover(LenPlane *P, int h1, int c0, int c1) {
+    if (h1 < P->lo1) P->lo1 = (uint8_t)h1;
+    if (h1 > P->hi1) P->hi1 = (uint8_t)h1;
+    if (c0 < P->lo2) P->lo2 = (uint8_t)c0;
+    if (c1 > P->hi2) P->hi2 = (uint8_t)c1;
+    if (c0 < P->rowLo[h1]) P->rowLo[h1] = (uint8_t)c0;
+    if (c1 > P->rowHi[h1]) P->rowHi[h1] = (uint8_t)c1;
+}
+
+/* h2 must be inside the row */
+static float *lenCell(LenLayer *L, const LenPlane *P, int h1, int h2) { return &L->cell[P->row[h1] + (size_t)(h2 - P->rowLo[h1])]; }
+
+/* Packs every covered row of L into its cell array, zeroed */
+static void lenAllocCells(LenLayer *L) {
+    size_t n = 0;
+    for (uint32_t i=0;i<L->rest.count;i++) {
+        LenPlane *P = &L->plane[i];
+        for (int h=P->lo1;h<=P->hi1;h++)
+            if (P->rowLo[h] <= P->rowHi[h]) { P->row[h] = (uint32_t)n; n += P->rowHi[h] - P->rowLo[h] + 1; }
+    }
+    if (n > L->cellCap) {
+        free(L->cell);
+        L->cellCap = n + n/4;
+        L->cell = malloc(L->cellCap * sizeof(float));
+    }
+    memset(L->cell, 0, n * sizeof(float));
+    L->cellCount = n;
+}
+
+static int lenEdgeCmp(const void *x, const void *y) {
+    const LenEdge *a = x, *b = y;
+    if (a->split != b->split) return a->split - b->split;
+    if (a->next  != b->next)  return a->next < b->next ? -1 : 1;
+    if (a->d1    != b->d1)    return a->d1 - b->d1;
+    return a->d2 - b->d2;
+}
+
+/* Edges out of rest at the HP buckets of h1/h2 */
+static uint32_t lenKernel(LenChain *C, uint64_t rest, int h1, int h2) {
+    SolveLayer *K = &C->kernel;
+    uint64_t key = rest | (uint64_t)C->bucket[0][h1] << 46 | (uint64_t)C->bucket[1][h2] << 51;
+    uint32_t had = K->count, k = layerFind(K, key, 1);
+    if (K->count == had) return k;
+    if (k >= C->kCap) {
+        C->kCap   = K->cap;
+        C->kStart = realloc(C->kStart, C->kCap * sizeof(uint32_t));
+        C->kCount = realloc(C->kCount, C->kCap * sizeof(uint32_t));
+    }
+
+    Fighter p1, p2;
+    double o1[5], o2[5];
+    lenUnpack(C, rest | (uint64_t)h1 | (uint64_t)h2 << 23, &p1, &p2);
+    aiPolicyOdds(C->ai, &p1, &p2, o1);
+    aiPolicyOdds(C->ai, &p2, &p1, o2);
+    size_t start = C->edgeCount;
+    ChanceTrace trace;
+    gChance = &trace;
+    for (int a=0;a<5;a++)
+    for (int b=0;b<5;b++) {
+        if (o1[a] <= 0 || o2[b] <= 0) continue;
+        trace.len = trace.pos = 0;
+        do {
+            Fighter x = p1, y = p2;
+            resolveTurn(&x, &y, a, b, NULL);
+            if (C->edgeCount == C->edgeCap) {
+                C->edgeCap = C->edgeCap ? C->edgeCap*2 : 4096;
+                C->edge = realloc(C->edge, C->edgeCap * sizeof(LenEdge));
+            }
+            LenEdge *e = &C->edge[C->edgeCount++];
+            memset(e, 0, sizeof(*e));
+            e->p     = o1[a] * o2[b] * chanceProb(&trace);
+            e->split = (p1.classId == CLASS_ALCHEMIST && a == MOVE_ULT) || (p2.classId == CLASS_ALCHEMIST && b == MOVE_ULT);
+            if (e->split) {
+                e->a = (uint8_t)a; e->b = (uint8_t)b; e->len = (uint8_t)trace.len;
+                for (int i=0;i<trace.len;i++) e->hits |= (uint32_t)trace.hit[i] << i;
+            } else {
+                e->d1 = (int16_t)(x.hp - p1.hp);
+                e->d2 = (int16_t)(y.hp - p2.hp);
+                x.hp = y.hp = 0;   /* may be < 0 here, which would spill into the key */
+                e->next = solvePack(&x, &y);
+            }
+        } while (chanceNext(&trace));
+    }
+    gChance = NULL;
+
+    /* Many paths land on the same rest and HP change: fold them */
+    LenEdge *e = C->edge + start;
+    size_t n = C->edgeCount - start, m = 0;
+    qsort(e, n, sizeof(LenEdge), lenEdgeCmp);
+    for (size_t i=0;i<n;i++) {
+        if (m && !e[i].split && !e[m-1].split && !lenEdgeCmp(&e[i], &e[m-1])) e[m-1].p += e[i].p;
+        else e[m++] = e[i];
+    }
+    C->edgeCount = start + m;
+    C->kStart[k] = (uint32_t)start;
+    C->kCount[k] = (uint32_t)m;
+    return k;
+}
+
+/* Rows r0..r1, columns c0..c1 of P along e: first pass (move 0) covers the
+ * target rows, second (move 1) moves the mass and counts KOs */
+static void lenShift(LenChain *C, int cur, const LenPlane *P, const LenEdge *e, int move, int r0, int r1, int c0, int c1) {
+    LenLayer *L = &C->layer[cur], *N = &C->layer[!cur];
+    float p = (float)e->p;
+    double ko[3] = {0};
+    LenPlane *Q = NULL;
+    for (int h1=r0;h1<=r1;h1++) {
+        int lo = P->rowLo[h1] > c0 ? P->rowLo[h1] : c0, hi = P->rowHi[h1] < c1 ? P->rowHi[h1] : c1;
+        if (lo > hi) continue;
+        int n1 = h1 + e->d1, s = 1 - e->d2 > lo ? 1 - e->d2 : lo;   /* from column s P2 stays up */
+        if (!move) {
+            if (n1 <= 0 || s > hi) continue;
+            if (!Q) { uint32_t q = lenPlane(N, e->next); Q = &N->plane[q]; }
+            lenCover(Q, n1, s + e->d2, hi + e->d2);
+            continue;
+        }
+        const float *row = lenCell(L, P, h1, lo);
+        double down = 0, both = 0;
+        for (int h2=lo;h2<s && h2<=hi;h2++) both += row[h2-lo];
+        if (n1 <= 0) {
+            for (int h2=s;h2<=hi;h2++) down += row[h2-lo];
+            ko[1] += down; ko[2] += both;
+            continue;
+        }
+        ko[0] += both;
+        if (s > hi) continue;
+        if (!Q) Q = &N->plane[layerFind(&N->rest, e->next, 0)];
+        float *dst = lenCell(N, Q, n1, s + e->d2);
+        const float *src = row + (s-lo);
+        for (int j=0;j<=hi-s;j++) dst[j] += p * src[j];
+    }
+    for (int i=0;i<3;i++) C->ko[C->turns][i] += p * ko[i];
+}
+
+/* Split edges: HP after the turn depends on HP before, so each cell is run
+ * (in the first pass) and its result queued as a drop */
+static void lenReplay(LenChain *C, int cur, uint64_t rest, const LenPlane *P, const LenEdge *e, int r0, int r1, int c0, int c1) {
+    LenLayer *L = &C->layer[cur], *N = &C->layer[!cur];
+    ChanceTrace trace = { .len = e->len };
+    for (int i=0;i<e->len;i++) trace.hit[i] = e->hits >> i & 1;
+    for (int h1=r0;h1<=r1;h1++)
+    for (int h2=c0>P->rowLo[h1] ? c0 : P->rowLo[h1]; h2<=c1 && h2<=P->rowHi[h1]; h2++) {
+        float m = *lenCell(L, P, h1, h2);
+        if (m == 0) continue;
+        m *= (float)e->p;
+        Fighter x, y;
+        lenUnpack(C, rest | (uint64_t)h1 | (uint64_t)h2 << 23, &x, &y);
+        trace.pos = 0;
+        gChance = &trace;
+        resolveTurn(&x, &y, e->a, e->b, NULL);
+        gChance = NULL;
+        int d1 = x.hp<=0, d2 = y.hp<=0;
+        if (d1 || d2) { C->ko[C->turns][d1 && d2 ? 2 : d1] += m; continue; }
+        if (x.hp > 255) x.hp = 255;   /* the key holds 8 bits */
+        if (y.hp > 255) y.hp = 255;
+        uint32_t q = lenPlane(N, solvePack(&x, &y) & ~LEN_HP_BITS);
+        lenCover(&N->plane[q], x.hp, y.hp, y.hp);
+        if (C->dropCount == C->dropCap) {
+            C->dropCap = C->dropCap ? C->dropCap*2 : 4096;
+            C->drop = realloc(C->drop, C->dropCap * sizeof(LenDrop));
+        }
+        C->drop[C->dropCount++] = (LenDrop){ q, (uint8_t)x.hp, (uint8_t)y.hp, m };
+    }
+}
+
+/* Every (bucket region, edge) of every plane in the current layer */
+static void lenSweep(LenChain *C, int move) {
+    int cur = (C->turns - 1) & 1;
+    LenLayer *L = &C->layer[cur];
+    for (uint32_t i=0;i<L->rest.count;i++) {
+        const LenPlane *P = &L->plane[i];
+        uint64_t rest = L->rest.keys[i];
+        for (int r0=P->lo1, r1; r0<=P->hi1; r0=r1+1) {
+            for (r1=r0; r1<P->hi1 && C->bucket[0][r1+1]==C->bucket[0][r0]; r1++) ;
+            for (int c0=P->lo2, c1; c0<=P->hi2; c0=c1+1) {
+                for (c1=c0; c1<P->hi2 && C->bucket[1][c1+1]==C->bucket[1][c0]; c1++) ;
+                uint32_t k = lenKernel(C, rest, r0, c0);
+                for (uint32_t j=0;j<C->kCount[k];j++) {
+                    const LenEdge *e = &C->edge[C->kStart[k] + j];
+                    if (!e->split)  lenShift(C, cur, P, e, move, r0, r1, c0, c1);
+                    else if (!move) lenReplay(C, cur, rest, P, e, r0, r1, c0, c1);
+                }
+            }
+        }
+    }
+}
+
+static void lenStep(LenChain *C) {
+    LenLayer *N = &C->layer[!(C->turns & 1)];
+    layerClear(&N->rest);
+    C->turns++;
+    C->dropCount = 0;
+    lenSweep(C, 0);
+    lenAllocCells(N);
+    lenSweep(C, 1);
+    for (size_t i=0;i<C->dropCount;i++) {
+        const LenDrop *d = &C->drop[i];
+        *lenCell(N, &N->plane[d->plane], d->h1, d->h2) += d->m;
+    }
+    if (N->cellCount > C->peakCells) C->peakCells = N->cellCount;
+
+    /* Drop dust, trim rows to what's left, and tally the standings of the
+     * ones still going: what a limit here would decide */
+    double *lead = C->lead[C->turns];
+    for (uint32_t i=0;i<N->rest.count;i++) {
+        LenPlane *P = &N->plane[i];
+        for (int h1=P->lo1;h1<=P->hi1;h1++) {
+            int lo = P->rowLo[h1], hi = P->rowHi[h1], first = 256, last = -1;
+            if (lo > hi) continue;
+            float *row = lenCell(N, P, h1, lo);
+            for (int h2=lo;h2<=hi;h2++) {
+                float m = row[h2-lo];
+                if (m < C->floor) { C->lost += m; row[h2-lo] = 0; continue; }
+                if (first > 255) first = h2;
+                last = h2;
+                lead[h1>h2 ? 0 : h1<h2 ? 1 : 2] += m;
+            }
+            if (last < 0) { P->rowLo[h1] = 255; P->rowHi[h1] = 0; continue; }
+            P->row[h1] += (uint32_t)(first - lo);
+            P->rowLo[h1] = (uint8_t)first;
+            P->rowHi[h1] = (uint8_t)last;
+        }
+    }
+}
+
+void lenFree(LenChain *C) {
+    for (int l=0;l<2;l++) {
+        LenLayer *L = &C->layer[l];
+        free(L->plane); free(L->cell);
+        layerFree(&L->rest);
+    }
+    layerFree(&C->kernel);
+    free(C->kStart); free(C->kCount); free(C->edge); free(C->drop);
+}
+
+/* classA vs classB, both on the active AI, until the outcome is certain or
+ * horizon turns have gone. Cells under floor are dropped. */
+void lenRun(LenChain *C, int classA, int classB, int horizon, float floor) {
+    memset(C, 0, sizeof(*C));
+    initFighter(&C->base[0], "P1", classA);
+    initFighter(&C->base[1], "P2", classB);
+    C->ai    = aiActive();
+    C->floor = floor;
+    for (int s=0;s<2;s++)
+        for (int h=0;h<256;h++) {
+            int pct = h * 100 / C->base[s].maxHp;
+            C->bucket[s][h] = C->ai->hpBucket[pct > 100 ? 100 : pct];
+        }
+    LenLayer *L = &C->layer[0];
+    uint32_t first = lenPlane(L, solvePack(&C->base[0], &C->base[1]) & ~LEN_HP_BITS);
+    LenPlane *P = &L->plane[first];
+    lenCover(P, C->base[0].maxHp, C->base[1].maxHp, C->base[1].maxHp);
+    lenAllocCells(L);
+    *lenCell(L, P, C->base[0].maxHp, C->base[1].maxHp) = 1.0f;
+    if (horizon > LEN_HORIZON) horizon = LEN_HORIZON;
+    while (C->turns < horizon) {
+        lenStep(C);
+        double *l = C->lead[C->turns];
+        if (l[0] + l[1] + l[2] < 1e-9) break;
+    }
+}
+
+static const int LEN_LIMITS[] = { 10, 12, 15, 20, MAX_TURNS };
+#define LEN_LIMIT_COUNT (int)(sizeof(LEN_LIMITS)/sizeof(LEN_LIMITS[0]))
+
+/* Chance a match is still going after `limit` turns (ends on HP) */
+static double lenGoing(const LenChain *C, int limit) {
+    if (limit > C->turns) return 0;
+    return C->lead[limit][0] + C->lead[limit][1] + C->lead[limit][2];
+}
+
+/* --lengths all|A,B [--len-floor F] [--csv FILE] */
+int lengthsMain(const char *matchup, float floor, const char *csvPath) {
+    int pairs[9][2], n = 0;
+    if (!strcmp(matchup, "all")) {
+        for (int a=0;a<3;a++) for (int b=0;b<3;b++) { pairs[n][0] = a; pairs[n][1] = b; n++; }
+    } else {
+        char a[32] = {0}, b[32] = {0};
+        pairs[0][0] = pairs[0][1] = -1;
+        if (sscanf(matchup, "%31[a-z],%31[a-z]", a, b) == 2)
+            for (int c=0;c<3;c++) {
+                if (!strcmp(a, CLASS_KEY[c])) pairs[0][0] = c;
+                if (!strcmp(b, CLASS_KEY[c])) pairs[0][1] = c;
+            }
+        if (pairs[0][0] < 0 || pairs[0][1] < 0) {
+            fprintf(stderr, "--lengths wants all or CLASS,CLASS (knight/magician/alchemist)\n");
+            return 1;
+        }
+        n = 1;
+    }
+    FILE *csv = NULL;
+    if (csvPath && !(csv = fopen(csvPath, "w"))) { fprintf(stderr, "%s: cannot write\n", csvPath); return 1; }
+    if (csv) fprintf(csv, "p1,p2,turn,ko_p1_wins,ko_p2_wins,ko_both,going_p1_ahead,going_p2_ahead,going_level\n");
+
+    static LenChain C;
+    printf("Duel length, AI '%s' on both sides; exact but for the dropped mass (floor %g)\n", aiActive()->name, floor);
+    char limitCol[16];
+    snprintf(limitCol, sizeof(limitCol), "going@%d", MAX_TURNS);
+    printf("%-21s %5s %6s %4s  %-10s %-10s %-10s %8s %6s\n", "P1 vs P2", "mean", "median", "p99",
+           limitCol, "P1 on HP", "P2 on HP", "dropped", "secs");
+    double going[9][LEN_LIMIT_COUNT];
+    for (int i=0;i<n;i++) {
+        uint64_t t0 = nowNs();
+        lenRun(&C, pairs[i][0], pairs[i][1], LEN_HORIZON, floor);
+        double ended = 0, sum = 0;
+        int median = 0, p99 = 0;
+        for (int t=1;t<=C.turns;t++) {
+            double e = C.ko[t][0] + C.ko[t][1] + C.ko[t][2];
+            ended += e; sum += t*e;
+            if (!median && ended >= 0.5)  median = t;
+            if (!p99    && ended >= 0.99) p99    = t;
+        }
+        const double *lead = C.lead[MAX_TURNS <= C.turns ? MAX_TURNS : 0];
+        char name[32];
+        snprintf(name, sizeof(name), "%s vs %s", CLASS_KEY[pairs[i][0]], CLASS_KEY[pairs[i][1]]);
+        printf("%-21s %5.2f %6d %4d  %-10.3e %-10.3e %-10.3e %8.1e %6.1f\n", name, sum/ended, median, p99,
+               lenGoing(&C, MAX_TURNS), lead[0], lead[1], C.lost, (nowNs()-t0)*1e-9);
+        fflush(stdout);
+        for (int l=0;l<LEN_LIMIT_COUNT;l++) going[i][l] = lenGoing(&C, LEN_LIMITS[l]);
+        if (csv)
+            for (int t=1;t<=C.turns;t++)
+                fprintf(csv, "%s,%s,%d,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n", CLASS_KEY[pairs[i][0]], CLASS_KEY[pairs[i][1]], t,
+                        C.ko[t][0], C.ko[t][1], C.ko[t][2], C.lead[t][0], C.lead[t][1], C.lead[t][2]);
+        lenFree(&C);
+    }
+    if (csv) fclose(csv);
+
+    printf("\nChance the turn limit decides the match, by limit\n%-21s", "P1 vs P2");
+    for (int l=0;l<LEN_LIMIT_COUNT;l++) printf("  %8d", LEN_LIMITS[l]);
+    printf("\n");
+    for (int i=0;i<n;i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "%s vs %s", CLASS_KEY[pairs[i][0]], CLASS_KEY[pairs[i][1]]);
+        printf("%-21s", name);
+        for (int l=0;l<LEN_LIMIT_COUNT;l++) printf("  %8.2e", going[i][l]);
+        printf("\n");
+    }
+    return 0;
+}
+
+/* ===================== GAUNTLET ENUMERATION ===================== */
+/*
+ * --gauntlet CLASS enumerates every gauntlet position turn by turn, with the
+ * player on --player-ai (default: --ai) against the first living enemy (the
+ * default target) and the enemies on --ai, and tallies how runs end: cleared,
+ * fallen, or out of time. The sum of the cleared column is the exact clear
+ * probability.
+ *
+ * Keys are canonical. A dead enemy never acts again, is never targeted, and
+ * keeps nothing that matters, so it drops out of the key: the living enemies
+ * are packed to the front in their old order, each with its class. Order
+ * among the living is kept, since it is their order of play and decides the
+ * target; "Magician, Alchemist" is the same position whichever slot the
+ * fallen Knight had been in.
+ *
+ * With the real classes a run is ~290k positions by turn 4 for any
+ * champion (Knight 290,736, Magician 288,201, Alchemist 300,176), and that
+ * turn alone takes about 85 s; every position branches over four fighters'
+ * rolls. So runs are for the first few turns, not the full MAX_TURNS.
+ *
+ * Four fighters are far too many positions for RAM, so layers live on disk as
+ * files of (key, chance) records sorted by key. Expanding a layer fills a
+ * --mem sized buffer with children; each full buffer is sorted, folded (same
+ * key: chances add) and written out as a run, and the runs are merged into
+ * the next layer's file. Layers and runs are read through mmap, in order, so
+ * the page cache does the buffering. Files go in --tmp DIR and are removed
+ * once read.
+ */
+#ifndef _WIN32
+
+typedef struct { uint64_t lo, hi; double p; } GauntRec;   /* lo: enemies 0,1  hi: enemy 2, player */
+
+#define GAUNT_ENEMY_BITS 25   /* solver side + class+1; 0 = nobody */
+
+typedef struct { const GauntRec *rec; size_t count, bytes; } GauntMap;
+
+typedef struct {
+    Fighter         player, enemy[3];   /* templates (enemy[] by class); keys overwrite the rest */
+    const AiPolicy *ai;                 /* player's policy */
+    const char     *dir;
+    GauntRec       *buf;
+    size_t          bufCount, bufCap, from;   /* from: first child of the position being expanded */
+    int             runs, turn;
+    double          cleared[MAX_TURNS+1], fallen[MAX_TURNS+1], timedOut;
+} GauntEnum;
+
+/* Player: HP 11 bits (scaled HP goes past 255), charge, buff, sunder; no DoT
+ * lands on the player in the gauntlet */
+static uint64_t gauntPackPlayer(const Fighter *f) {
+    return (uint64_t)f->hp | (uint64_t)f->charge<<11 | (uint64_t)f->buffTurns<<15
+         | (uint64_t)(f->buffActive!=0)<<17 | (uint64_t)(f->defPenalty/2)<<18;
+}
+
+static void gauntUnpackPlayer(Fighter *f, const Fighter *base, uint64_t k) {
+    *f = *base;
+    f->hp         = (int)(k & 2047);
+    f->charge     = (int)(k>>11 & 15);
+    f->buffTurns  = (int)(k>>15 & 3);
+    f->buffActive = (int)(k>>17 & 1);
+    f->defPenalty = (int)(k>>18 & 15) * 2;
+}
+
+static GauntRec gauntPack(const Fighter *pl, const Fighter *en, double p) {
+    uint64_t k[3] = {0, 0, 0};
+    for (int i=0, n=0;i<3;i++)
+        if (en[i].hp > 0) k[n++] = solvePackSide(&en[i]) | (uint64_t)(en[i].classId+1) << 23;
+    return (GauntRec){ k[0] | k[1] << GAUNT_ENEMY_BITS, k[2] | gauntPackPlayer(pl) << GAUNT_ENEMY_BITS, p };
+}
+
+static void gauntUnpackEnemy(const GauntEnum *G, Fighter *e, uint64_t k) {
+    int cls = (int)(k >> 23 & 3);
+    solveUnpackSide(e, &G->enemy[cls ? cls-1 : 0], (uint32_t)(k & 0x7fffff));
+    if (!cls) e->hp = 0;
+}
+
+static void gauntUnpack(const GauntEnum *G, const GauntRec *r, Fighter *pl, Fighter *en) {
+    const uint64_t m = (1ull << GAUNT_ENEMY_BITS) - 1;
+    gauntUnpackEnemy(G, &en[0], r->lo & m);
+    gauntUnpackEnemy(G, &en[1], r->lo >> GAUNT_ENEMY_BITS & m);
+    gauntUnpackEnemy(G, &en[2], r->hi & m);
+    gauntUnpackPlayer(pl, &G->player, r->hi >> GAUNT_ENEMY_BITS);
+}
+
+static int gauntCmp(const GauntRec *a, const GauntRec *b) {
+    if (a->hi != b->hi) return a->hi < b->hi ? -1 : 1;
+    if (a->lo != b->lo) return a->lo < b->lo ? -1 : 1;
+    return 0;
+}
+
+static int gauntQsortCmp(const void *a, const void *b) { return gauntCmp(a, b); }
+
+static void gauntPath(char *out, size_t n, const GauntEnum *G, const char *kind, int i) {
+    snprintf(out, n, "%s/tbc_gauntlet_%s_%04d.bin", G->dir, kind, i);
+}
+
+static int gauntMap(const char *path, GauntMap *m) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    memset(m, 0, sizeof(*m));
+    if (fd < 0 || fstat(fd, &st)) { if (fd >= 0) close(fd); fprintf(stderr, "%s: cannot read\n", path); return 1; }
+    m->bytes = (size_t)st.st_size;
+    m->count = m->bytes / sizeof(GauntRec);
+    if (m->count) {
+        void *p = mmap(NULL, m->bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { close(fd); fprintf(stderr, "%s: cannot map\n", path); return 1; }
+        posix_madvise(p, m->bytes, POSIX_MADV_SEQUENTIAL);
+        m->rec = p;
+    }
+    close(fd);   /* the mapping keeps the file */
+    return 0;
+}
+
+static void gauntUnmap(GauntMap *m) {
+    if (m->count) munmap((void *)m->rec, m->bytes);
+    memset(m, 0, sizeof(*m));
+}
+
+/* Sorts, folds and writes the buffer as the next run */
+static int gauntFlush(GauntEnum *G) {
+    if (!G->bufCount) return 0;
+    qsort(G->buf, G->bufCount, sizeof(GauntRec), gauntQsortCmp);
+    size_t m = 0;
+    for (size_t i=0;i<G->bufCount;i++) {
+        if (m && !gauntCmp(&G->buf[i], &G->buf[m-1])) G->buf[m-1].p += G->buf[i].p;
+        else G->buf[m++] = G->buf[i];
+    }
+    char path[512];
+    gauntPath(path, sizeof(path), G, "run", G->runs);
+    FILE *f = fopen(path, "wb");
+    if (!f || fwrite(G->buf, sizeof(GauntRec), m, f) != m) {
+        if (f) fclose(f);
+        fprintf(stderr, "%s: cannot write\n", path);
+        return 1;
+    }
+    fclose(f);
+    G->runs++;
+    G->bufCount = G->from = 0;
+    return 0;
+}
+
+/* Folds the children of one position in place; most paths of a turn end in
+ * the same few dozen positions, so this keeps runs small */
+static void gauntFold(GauntEnum *G) {
+    size_t n = G->bufCount - G->from, m = 0;
+    GauntRec *r = G->buf + G->from;
+    qsort(r, n, sizeof(GauntRec), gauntQsortCmp);
+    for (size_t i=0;i<n;i++) {
+        if (m && !gauntCmp(&r[i], &r[m-1])) r[m-1].p += r[i].p;
+        else r[m++] = r[i];
+    }
+    G->bufCount = G->from + m;
+}
+
+static int gauntEmit(GauntEnum *G, GauntRec r) {
+    if (G->bufCount == G->bufCap && gauntFlush(G)) return 1;
+    G->buf[G->bufCount++] = r;
+    return 0;
+}
+
+/* k-way merge of the runs into layer file `out`; removes the runs */
+static int gauntMerge(GauntEnum *G, const char *out, size_t *states) {
+    int k = G->runs, n = 0, err = 0;
+    GauntMap *run = calloc((size_t)k + 1, sizeof(GauntMap));
+    size_t   *at  = calloc((size_t)k + 1, sizeof(size_t));
+    int      *heap = malloc(((size_t)k + 1) * sizeof(int));
+    char path[512];
+    for (int r=0;r<k && !err;r++) {
+        gauntPath(path, sizeof(path), G, "run", r);
+        err = gauntMap(path, &run[r]);
+        if (!err && run[r].count) heap[n++] = r;
+    }
+    FILE *f = err ? NULL : fopen(out, "wb");
+    if (!err && !f) { fprintf(stderr, "%s: cannot write\n", out); err = 1; }
+    if (f) setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+#define GAUNT_HEAD(r) (&run[r].rec[at[r]])
+#define GAUNT_LESS(a, b) (gauntCmp(GAUNT_HEAD(heap[a]), GAUNT_HEAD(heap[b])) < 0)
+    for (int i=n/2-1;i>=0;i--)
+        for (int j=i, c; (c = 2*j+1) < n; j = c) {
+            if (c+1 < n && GAUNT_LESS(c+1, c)) c++;
+            if (!GAUNT_LESS(c, j)) break;
+            int t = heap[j]; heap[j] = heap[c]; heap[c] = t;
+        }
+    GauntRec cur = {0};
+    int have = 0;
+    *states = 0;
+    while (!err && n) {
+        int r = heap[0];
+        GauntRec rec = *GAUNT_HEAD(r);
+        if (++at[r] == run[r].count) heap[0] = heap[--n];
+        for (int j=0, c; (c = 2*j+1) < n; j = c) {
+            if (c+1 < n && GAUNT_LESS(c+1, c)) c++;
+            if (!GAUNT_LESS(c, j)) break;
+            int t = heap[j]; heap[j] = heap[c]; heap[c] = t;
+        }
+        if (have && !gauntCmp(&cur, &rec)) { cur.p += rec.p; continue; }
+        if (have && fwrite(&cur, sizeof(cur), 1, f) != 1) err = 1;
+        cur = rec; have = 1; (*states)++;
+    }
+#undef GAUNT_LESS
+#undef GAUNT_HEAD
+    if (!err && have && fwrite(&cur, sizeof(cur), 1, f) != 1) err = 1;
+    if (f && fclose(f)) err = 1;
+    if (err) fprintf(stderr, "%s: merge failed\n", out);
+
+    for (int r=0;r<k;r++) {
+        gauntUnmap(&run[r]);
+        gauntPath(path, sizeof(path), G, "run", r);
+        remove(path);
+    }
+    free(run); free(at); free(heap);
+    G->runs = 0;
+    return err;
+}
+
+/* Plays every path of one turn from every position in layer L */
+static int gauntExpand(GauntEnum *G, const GauntMap *L) {
+    ChanceTrace trace;
+    for (size_t i=0;i<L->count;i++) {
+        Fighter pl0, en0[3];
+        gauntUnpack(G, &L->rec[i], &pl0, en0);
+        int tgt = 0;
+        while (en0[tgt].hp <= 0) tgt++;
+        trace.len = trace.pos = 0;
+        G->from = G->bufCount;
+        do {
+            Fighter pl = pl0, en[3] = { en0[0], en0[1], en0[2] };
+            gChance = &trace;
+            int move = aiPolicyChoose(G->ai, &pl, &en[tgt]);
+            gauntletTurn(&pl, en, move, tgt, NULL);
+            gChance = NULL;
+            double p = L->rec[i].p * chanceProb(&trace);
+            if (pl.hp <= 0)                                        G->fallen[G->turn]  += p;
+            else if (en[0].hp <= 0 && en[1].hp <= 0 && en[2].hp <= 0) G->cleared[G->turn] += p;
+            else if (G->turn == MAX_TURNS)                          G->timedOut         += p;
+            else if (gauntEmit(G, gauntPack(&pl, en, p)))          return 1;
+        } while (chanceNext(&trace));
+        gauntFold(G);
+    }
+    return gauntFlush(G);
+}
+
+/* --gauntlet CLASS [--gauntlet-turns N] [--player-ai NAME] [--tmp DIR] [--mem MB] */
+int gauntletMain(const char *cls, int turns, const AiPolicy *player, const char *dir, int memMb) {
+    int c = 0;
+    while (c < 3 && strcmp(cls, CLASS_KEY[c])) c++;
+    if (c == 3) { fprintf(stderr, "--gauntlet wants knight, magician or alchemist\n"); return 1; }
+    if (turns < 1 || turns > MAX_TURNS) turns = MAX_TURNS;
+
+    static GauntEnum G;
+    static GameState gs;
+    initFighter(&gs.p1, "You", c);
+    initGauntlet(&gs);
+    G.player = gs.p1;
+    memcpy(G.enemy, gs.enemies, sizeof(G.enemy));
+    G.ai     = player ? player : aiActive();
+    G.dir    = dir;
+    G.bufCap = ((size_t)(memMb > 0 ? memMb : 1) << 20) / sizeof(GauntRec);
+    G.buf    = malloc(G.bufCap * sizeof(GauntRec));
+    if (!G.buf) { fprintf(stderr, "--mem %d: out of memory\n", memMb); return 1; }
+
+    printf("Gauntlet as %s (you: AI '%s' on the first alive, enemies: AI '%s'), %d turns, layers in %s\n",
+           CLASS_KEY[c], G.ai->name, aiActive()->name, turns, dir);
+    printf("%4s %14s %10s %5s %12s %12s %12s %7s\n", "turn", "positions", "MB", "runs", "cleared", "fallen", "going", "secs");
+    char layer[512], next[512];
+    size_t states = 0;
+    int err = gauntEmit(&G, gauntPack(&G.player, G.enemy, 1.0)) || gauntFlush(&G);
+    gauntPath(layer, sizeof(layer), &G, "layer", 1);
+    if (!err) err = gauntMerge(&G, layer, &states);
+
+    double cleared = 0, fallen = 0, going = 1;
+    for (G.turn=1; !err && G.turn<=turns && states; G.turn++) {
+        uint64_t t0 = nowNs();
+        GauntMap L;
+        if ((err = gauntMap(layer, &L))) break;
+        size_t layerBytes = L.bytes;
+        err = gauntExpand(&G, &L);
+        int runs = G.runs;
+        gauntUnmap(&L);
+        remove(layer);
+        gauntPath(next, sizeof(next), &G, "layer", G.turn+1);
+        if (!err) err = gauntMerge(&G, next, &states);
+        cleared += G.cleared[G.turn];
+        fallen  += G.fallen[G.turn];
+        going    = 1 - cleared - fallen - G.timedOut;
+        printf("%4d %14zu %10.1f %5d %12.6f %12.6f %12.6f %7.1f\n", G.turn, layerBytes / sizeof(GauntRec),
+               layerBytes / 1048576.0, runs, cleared, fallen, going, (nowNs()-t0)*1e-9);
+        fflush(stdout);
+        memcpy(layer, next, sizeof(layer));
+    }
+    remove(layer);
+    if (!err) {
+        printf("clear probability %.9f, fallen %.9f", cleared, fallen);
+        if (G.turn > MAX_TURNS) printf(", out of time %.9f\n", G.timedOut);
+        else                    printf(", still going after turn %d %.9f\n", G.turn-1, going);
+    }
+    free(G.buf);
+    return err;
+}
+
+#else
+
+int gauntletMain(const char *cls, int turns, const AiPolicy *player, const char *dir, int memMb) {
+    (void)cls; (void)turns; (void)player; (void)dir; (void)memMb;
+    fprintf(stderr, "--gauntlet needs mmap (not built on Windows)\n");
+    return 1;
+}
+
+#endif
+
+/* ===================== BALANCE REGRESSION ===================== */
+/*
+ * --balance-check FILE replays a fixed, seeded suite and compares it with
+ * the baseline in FILE (bench/balance_baseline.txt); --balance-save FILE
+ * writes a new one. Run the check after touching resolveTurn, the effect
+ * programs or the Balance table; save when a change is meant to move things.
+ *
+ * The suite is every duel matchup (AI vs AI: P1 score, length) and the
+ * gauntlet for each class (AI on the first living enemy: clear rate,
+ * length). Each suite's games are split into blocks with fixed seeds and the
+ * baseline keeps every block's means, so the check is paired: block b now
+ * replays block b's seeds and only the differences are tested. Shared seeds
+ * cancel most of the luck, so a real drift of a point or less shows up
+ * without huge game counts. A metric drifts when |mean diff| / SE > BALCHK_Z;
+ * with ~24 metrics that keeps false alarms near 1 in 200 checks. An
+ * unchanged build reproduces the baseline exactly.
+ */
+#define BALCHK_SUITES  12   /* 9 duel matchups, then 3 gauntlet classes */
+#define BALCHK_METRICS 2    /* score or clear rate, turns */
+#define BALCHK_GAMES   100000
+#define BALCHK_BLOCKS  50
+#define BALCHK_Z       4.0
+
+static const char *BALCHK_METRIC[BALCHK_METRICS] = { "score", "turns" };
+
+/* One gauntlet run with the player on the active AI: 1 cleared, 0 not */
+double simulateGauntlet(int cls, uint32_t seed, int *turns) {
+    static _Thread_local GameState gs;
+    seedRng(seed);
+    initFighter(&gs.p1, "You", cls);
+    initGauntlet(&gs);
+    for (int t=1;;t++) {
+        int tgt = firstAliveEnemy(&gs);
+        gauntletTurn(&gs.p1, gs.enemies, chooseMoveAI(&gs.p1, &gs.enemies[tgt]), tgt, NULL);
+        if (turns) *turns = t;
+        if (gs.p1.hp <= 0)      return 0;
+        if (allEnemiesDead(&gs)) return 1;
+        if (t == MAX_TURNS)     return 0;
+    }
+}
+
+typedef struct {
+    int        games, blocks;
+    atomic_int next;   /* next (suite, block) to hand out */
+    double     mean[BALCHK_SUITES][BALCHK_METRICS][BALCHK_BLOCKS];
+} BalJob;
+
+static void balSuiteName(int s, int m, char *out, size_t n) {
+    if (s < 9) snprintf(out, n, "duel.%s.%s.%s", CLASS_KEY[s/3], CLASS_KEY[s%3], BALCHK_METRIC[m]);
+    else       snprintf(out, n, "gauntlet.%s.%s", CLASS_KEY[s-9], BALCHK_METRIC[m]);
+}
+
+static void *balWorker(void *arg) {
+    BalJob *job = arg;
+    int per = job->games / job->blocks;
+    for (int j; (j = atomic_fetch_add(&job->next, 1)) < BALCHK_SUITES * job->blocks; ) {
+        int s = j / job->blocks, b = j % job->blocks;
+        double score = 0, turns = 0;
+        for (int at=b*per; at<(b+1)*per; at+=DUEL_BATCH) {
+            int n = (b+1)*per - at < DUEL_BATCH ? (b+1)*per - at : DUEL_BATCH, t[DUEL_BATCH];
+            uint32_t seed[DUEL_BATCH];
+            double r[DUEL_BATCH];
+            for (int i=0;i<n;i++) seed[i] = 0x9E3779B9u * (uint32_t)(at+i+1) + 0x85EBCA6Bu * (uint32_t)s;
+            if (s < 9) simulateDuels(s/3, s%3, seed, n, r, t);
+            else for (int i=0;i<n;i++) r[i] = simulateGauntlet(s-9, seed[i], &t[i]);
+            for (int i=0;i<n;i++) { score += r[i]; turns += t[i]; }
+        }
+        job->mean[s][0][b] = score / per;
+        job->mean[s][1][b] = turns / per;
+    }
+    return NULL;
+}
+
+static void balRun(BalJob *job) {
+    atomic_init(&job->next, 0);
+    aiActive();   /* compile the policy before the workers share it */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus < 1 ? 1 : cpus > SENS_MAX_THREADS ? SENS_MAX_THREADS : (int)cpus;
+    pthread_t tid[SENS_MAX_THREADS];
+    for (int i=0;i<threads;i++) pthread_create(&tid[i], NULL, balWorker, job);
+    for (int i=0;i<threads;i++) pthread_join(tid[i], NULL);
+}
+
+static double balMean(const double *v, int n) {
+    double s = 0;
+    for (int i=0;i<n;i++) s += v[i];
+    return s / n;
+}
+
+static int balSave(const char *path) {
+    static BalJob job;
+    job.games = BALCHK_GAMES; job.blocks = BALCHK_BLOCKS;
+    balRun(&job);
+    FILE *f = fopen(path, "w");
+    if (!f) { fprintf(stderr, "%s: cannot write\n", path); return 1; }
+    fprintf(f, "# Balance regression baseline; check with --balance-check %s, rewrite with\n"
+               "# --balance-save %s. Per metric: the mean of each block of games.\n", path, path);
+    fprintf(f, "games %d blocks %d ai %s\n", job.games, job.blocks, aiActive()->name);
+    char name[64];
+    for (int s=0;s<BALCHK_SUITES;s++)
+        for (int m=0;m<BALCHK_METRICS;m++) {
+            balSuiteName(s, m, name, sizeof(name));
+            fprintf(f, "%s", name);
+            for (int b=0;b<job.blocks;b++) fprintf(f, " %.6f", job.mean[s][m][b]);
+            fprintf(f, "\n");
+        }
+    fclose(f);
+    printf("wrote %s: %d suites x %d games\n", path, BALCHK_SUITES, job.games);
+    return 0;
+}
+
+static int balCheck(const char *path) {
+    static BalJob base, now;
+    char line[1024], ai[64] = "", name[64] = "", want[64], why[160] = "";
+    FILE *f = fopen(path, "r");
+    if (!f) { fprintf(stderr, "%s: cannot read\n", path); return 1; }
+    int s = 0, m = 0;
+    while (!why[0] && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        if (sscanf(line, "games %d blocks %d ai %63s", &base.games, &base.blocks, ai) == 3) {
+            if (base.blocks < 2 || base.blocks > BALCHK_BLOCKS || base.games < base.blocks)
+                snprintf(why, sizeof(why), "bad header: want 2..%d blocks and at least a game per block", BALCHK_BLOCKS);
+            continue;
+        }
+        int at = 0;
+        if (!base.blocks)                                       { snprintf(why, sizeof(why), "no header line"); break; }
+        if (s == BALCHK_SUITES)                                 { snprintf(why, sizeof(why), "extra rows"); break; }
+        balSuiteName(s, m, want, sizeof(want));
+        if (sscanf(line, "%63s%n", name, &at) != 1 || strcmp(name, want)) {
+            snprintf(why, sizeof(why), "expected %s", want);
+            break;
+        }
+        for (int b=0, k; b<base.blocks; b++, at += k)
+            if (sscanf(line+at, "%lf%n", &base.mean[s][m][b], &k) != 1) { snprintf(why, sizeof(why), "%s is short of blocks", name); break; }
+        if (++m == BALCHK_METRICS) { m = 0; s++; }
+    }
+    fclose(f);
+    if (!why[0] && !base.blocks) snprintf(why, sizeof(why), "no header line");
+    else if (!why[0] && s != BALCHK_SUITES) {
+        balSuiteName(s, m, want, sizeof(want));
+        snprintf(why, sizeof(why), "short: ends before %s", want);
+    }
+    if (why[0]) { fprintf(stderr, "%s: not a balance baseline (%s)\n", path, why); return 1; }
+    if (strcmp(ai, aiActive()->name)) {
+        fprintf(stderr, "%s was saved with --ai %s; this run uses %s\n", path, ai, aiActive()->name);
+        return 1;
+    }
+
+    now.games = base.games; now.blocks = base.blocks;
+    uint64_t t0 = nowNs();
+    balRun(&now);
+    printf("Balance check against %s: %d games per suite in %d paired blocks, %.1fs\n",
+           path, now.games, now.blocks, (nowNs()-t0)*1e-9);
+    printf("%-32s %10s %10s %10s %8s\n", "metric", "baseline", "now", "change", "z");
+    int drifted = 0, n = now.blocks;
+    for (s=0;s<BALCHK_SUITES;s++)
+        for (m=0;m<BALCHK_METRICS;m++) {
+            double d[BALCHK_BLOCKS], ss = 0;
+            for (int b=0;b<n;b++) d[b] = now.mean[s][m][b] - base.mean[s][m][b];
+            double mean = balMean(d, n);
+            for (int b=0;b<n;b++) ss += (d[b]-mean)*(d[b]-mean);
+            double se = sqrt(ss / (n-1) / n);
+            /* the file keeps 6 decimals: below that it's the same number */
+            double z = fabs(mean) < 1e-6 ? 0 : se > 0 ? mean / se : mean > 0 ? HUGE_VAL : -HUGE_VAL;
+            int drift = fabs(z) > BALCHK_Z;
+            drifted += drift;
+            balSuiteName(s, m, name, sizeof(name));
+            printf("%-32s %10.4f %10.4f %+10.4f %8.1f%s\n", name, balMean(base.mean[s][m], n),
+                   balMean(now.mean[s][m], n), mean, z, drift ? "  DRIFT" : "");
+        }
+    if (drifted) {
+        fflush(stdout);
+        fprintf(stderr, "BALANCE CHECK FAILED: %d metric%s drifted (|z| > %.0f). If that was the point, "
+                        "--balance-save %s.\n", drifted, drifted == 1 ? "" : "s", BALCHK_Z, path);
+        return 1;
+    }
+    printf("balance check passed\n");
+    return 0;
+}
+
+/* --balance-check FILE | --balance-save FILE */
+int balanceMain(const char *checkPath, const char *savePath) {
+    return savePath ? balSave(savePath) : balCheck(checkPath);
+}
+
+/* ===================== CO-OP LOOPBACK TEST ===================== */
+/*
+ * --coop-test N plays N networked co-op gauntlets between two peers, each on
+ * its own thread with its own GameState, talking only through a loopback
+ * CoopLink. A bot on each side steers its champion with key presses (moves
+ * and targets from its own generator, never the shared one). Both peers
+ * fold coopHash of every resolved turn into a trail; the run passes when
+ * every game's trails, turn counts and results agree.
+ */
+typedef struct {
+    CoopLink *link;
+    GameState gs;
+    uint32_t  seed, bot;
+    uint32_t  trail;
+    int       turns;
+} CoopPeer;
+
+static void *coopPeerMain(void *arg) {
+    CoopPeer *P = arg;
+    GameState *gs = &P->gs;
+    gRng = P->seed;
+    int want = -1, wantT = 0;
+    while (gs->screen != SCREEN_RESULT) {
+        InputFrame in;
+        memset(&in, 0, sizeof(in));
+        coopRecv(P->link, &in);
+
+        int s = gs->seat;
+        Fighter *me = s ? &gs->p2 : &gs->p1;
+        if (gs->screen == SCREEN_GAUNTLET_RESOLVE) {
+            in.buttons |= 1u << BTN_ENTER;
+            want = -1;
+        } else if (me->hp > 0 && !(gs->locked >> s & 1)) {
+            while (want < 0) {
+                P->bot ^= P->bot<<13; P->bot ^= P->bot>>17; P->bot ^= P->bot<<5;
+                want = (int)(P->bot % 5);
+                if (me->charge < getMoves(me->classId)[want].cost) want = -1;
+                wantT = nextTarget(gs, (int)(P->bot >> 8) % 3, 1);
+            }
+            int sel = s ? gs->selectedMove2 : gs->selectedMove;
+            int tgt = s ? gs->selectedTarget2 : gs->selectedTarget;
+            in.buttons |= 1u << (sel != want ? BTN_DOWN : tgt != wantT ? BTN_RIGHT : BTN_ENTER);
+        }
+        if (inputEmpty(&in)) {   /* waiting on the partner */
+            nanosleep(&(struct timespec){0, 20000}, NULL);
+            continue;
+        }
+        GameScreen was = gs->screen;
+        int wasTurn = gs->turn;
+        updateGame(gs, &in);
+        coopSend(P->link, gs);
+        /* a seat already ready when its turn opens resolves on the same frame */
+        if (gs->screen == SCREEN_GAUNTLET_RESOLVE && (was != SCREEN_GAUNTLET_RESOLVE || gs->turn != wasTurn)) {
+            P->trail = (P->trail ^ coopHash(gs)) * 16777619u;
+            P->turns++;
+        }
+    }
+    P->link->close(P->link);
+    return NULL;
+}
+
+int coopTestMain(int games) {
+    gSaveEnabled = 0;
+    static CoopPeer P[2];
+    static CoopPipe pipes[2];
+    CoopLink link[2];
+    int agreed = 0, cleared = 0;
+    long turns = 0;
+    uint64_t t0 = nowNs();
+    for (int g=0; g<games; g++) {
+        coopLoopback(&link[0], &link[1], pipes);
+        pthread_t th[2];
+        for (int s=0;s<2;s++) {
+            balUnpin(P[s].gs.bal);
+            memset(&P[s], 0, sizeof(P[s]));
+            P[s].link = &link[s];
+            P[s].seed = (uint32_t)g + 1;
+            P[s].bot  = 2654435761u * (uint32_t)(g + 1) + (uint32_t)s + 1;
+            GameState *gs = &P[s].gs;
+            initFighter(&gs->p1, "Champion 1", g % 3);
+            initFighter(&gs->p2, "Champion 2", g / 3 % 3);
+            initGauntlet(gs);
+            coopStart(gs, 2, s);
+            gs->vsComputer = 5;
+            gs->screen = SCREEN_GAUNTLET_BATTLE;
+            pthread_create(&th[s], NULL, coopPeerMain, &P[s]);
+        }
+        for (int s=0;s<2;s++) pthread_join(th[s], NULL);
+
+        int same = P[0].trail == P[1].trail && P[0].turns == P[1].turns &&
+                   !strcmp(P[0].gs.resultMsg, P[1].gs.resultMsg);
+        if (!same && g - agreed < 5)
+            printf("game %d: peers disagree (\"%s\" / \"%s\")\n", g, P[0].gs.resultMsg, P[1].gs.resultMsg);
+        agreed  += same;
+        cleared += allEnemiesDead(&P[0].gs);
+        turns   += P[0].turns;
+    }
+    double secs = (nowNs() - t0) * 1e-9;
+    printf("%d co-op games over loopback: %d in lockstep, %d cleared, %ld turns, %.1f us per turn\n",
+           games, agreed, cleared, turns, turns ? secs * 1e6 / (double)turns : 0.0);
+    return agreed == games ? 0 : 1;
+}
+
+/* ===================== MAIN ===================== */
+#ifndef TBC_ENGINE_SO
+
+int main(int argc, char **argv) {
+    float renderScale = 1.0f;
+    int   dynamicRes  = 0;
+    const char *playPath = NULL, *recordPath = NULL, *reportPath = NULL, *exportDir = NULL;
+    long  seedArg = -1;
+    const char *aiName = "default";
+    const char *solveArg = NULL, *emitPath = NULL;
+    int   solveTurns = 6, treeDepth = 6, retune = 0, sensGames = 0;
+    const char *csvPath = NULL, *lengths = NULL;
+    float lenFloor = 1e-12f;
+    const char *gauntletArg = NULL, *tmpDir = ".", *playerAi = NULL;
+    const char *balCheckPath = NULL, *balSavePath = NULL, *simExportDir = NULL;
+    int   simGames = 200000;
+    int   gauntletTurns = MAX_TURNS, memMb = 512;
+    const char *coopHost = NULL, *coopJoin = NULL, *coopClass = "knight";
+    int   coopTest = 0;
+    for (int i=1;i<argc;i++) {
+        if      (!strcmp(argv[i],"--render-scale") && i+1<argc) renderScale = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i],"--dynres"))                   dynamicRes  = 1;
+        else if (!strcmp(argv[i],"--play")   && i+1<argc)       playPath    = argv[++i];
+        else if (!strcmp(argv[i],"--record") && i+1<argc)       recordPath  = argv[++i];
+        else if (!strcmp(argv[i],"--report") && i+1<argc)       reportPath  = argv[++i];
+        else if (!strcmp(argv[i],"--seed")   && i+1<argc)       seedArg     = atol(argv[++i]);
+        else if (!strcmp(argv[i],"--export") && i+1<argc)       exportDir   = argv[++i];
+        else if (!strcmp(argv[i],"--engine") && i+1<argc)       gEngine.path = argv[++i];
+        else if (!strcmp(argv[i],"--balance-patch") && i+1<argc) gBalPatch.path = argv[++i];
+        else if (!strcmp(argv[i],"--ai")     && i+1<argc)       aiName      = argv[++i];
+        else if (!strcmp(argv[i],"--solve")  && i+1<argc)       solveArg    = argv[++i];
+        else if (!strcmp(argv[i],"--solve-turns") && i+1<argc)  solveTurns  = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--tree-depth")  && i+1<argc)  treeDepth   = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--emit")   && i+1<argc)       emitPath    = argv[++i];
+        else if (!strcmp(argv[i],"--retune"))                   retune      = 1;
+        else if (!strcmp(argv[i],"--sensitivity") && i+1<argc)  sensGames   = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--csv")    && i+1<argc)       csvPath     = argv[++i];
+        else if (!strcmp(argv[i],"--lengths") && i+1<argc)      lengths     = argv[++i];
+        else if (!strcmp(argv[i],"--len-floor") && i+1<argc)    lenFloor    = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i],"--gauntlet") && i+1<argc)     gauntletArg = argv[++i];
+        else if (!strcmp(argv[i],"--gauntlet-turns") && i+1<argc) gauntletTurns = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--player-ai") && i+1<argc)    playerAi    = argv[++i];
+        else if (!strcmp(argv[i],"--tmp")    && i+1<argc)       tmpDir      = argv[++i];
+        else if (!strcmp(argv[i],"--mem")    && i+1<argc)       memMb       = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--threads") && i+1<argc)      gSolveThreads = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--balance-check") && i+1<argc) balCheckPath = argv[++i];
+        else if (!strcmp(argv[i],"--balance-save") && i+1<argc)  balSavePath  = argv[++i];
+        else if (!strcmp(argv[i],"--sim-export") && i+1<argc)   simExportDir = argv[++i];
+        else if (!strcmp(argv[i],"--sim-games")  && i+1<argc)   simGames     = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--coop-host")  && i+1<argc)   coopHost     = argv[++i];
+        else if (!strcmp(argv[i],"--coop-join")  && i+1<argc)   coopJoin     = argv[++i];
+        else if (!strcmp(argv[i],"--coop-class") && i+1<argc)   coopClass    = argv[++i];
+        else if (!strcmp(argv[i],"--coop-test")  && i+1<argc)   coopTest     = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--render-scale F] [--dynres] [--play script] [--record script]\n"
+                            "          [--report frames.csv] [--seed N] [--export dir] [--engine lib.so] [--ai name]\n"
+                            "          [--balance-patch file]\n"
+                            "       %s --solve CLASS,CLASS [--solve-turns N] [--tree-depth N] [--emit file.c] [--retune] [--threads N]\n"
+                            "       %s --sensitivity GAMES [--csv file]\n"
+                            "       %s --lengths all|A,B [--len-floor F] [--csv file]\n"
+                            "       %s --gauntlet CLASS [--gauntlet-turns N] [--player-ai name] [--tmp dir] [--mem MB]\n"
+                            "       %s --balance-check|--balance-save bench/balance_baseline.txt\n"
+                            "       %s --sim-export DIR [--sim-games N]\n"
+                            "       %s --coop-host PORT|--coop-join HOST:PORT [--coop-class name] [--ai name]\n"
+                            "       %s --coop-test GAMES\n",
+                    argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+            return 1;
+        }
+    }
+    if (exportDir && !playPath) {
+        fprintf(stderr, "--export needs a --play script\n");
+        return 1;
+    }
+    if (exportDir && !exportDirReady(exportDir)) return 1;
+    if (exportDir) dynamicRes = 0;   /* every exported frame the same size */
+
+    aiLoadPolicies(AI_BUILTIN, "builtin");
+    aiLoadFile(AI_FILE);
+    if (!(gAi = aiFindPolicy(aiName))) {
+        fprintf(stderr, "no AI policy named %s\n", aiName);
+        return 1;
+    }
+    if (solveArg)  return solveMain(solveArg, solveTurns, treeDepth, emitPath, retune);
+    if (sensGames) return sensitivityMain(sensGames, csvPath);
+    if (lengths)   return lengthsMain(lengths, lenFloor, csvPath);
+    if (balCheckPath || balSavePath) return balanceMain(balCheckPath, balSavePath);
+    if (simExportDir) return simExportMain(simExportDir, simGames > 0 ? simGames : 1);
+    if (coopTest)  return coopTestMain(coopTest);
+    if (gauntletArg) {
+        const AiPolicy *pa = playerAi ? aiFindPolicy(playerAi) : NULL;
+        if (playerAi && !pa) { fprintf(stderr, "no AI policy named %s\n", playerAi); return 1; }
+        return gauntletMain(gauntletArg, gauntletTurns, pa, tmpDir, memMb);
+    }
+
+    /* A scripted run is a benchmark: fixed seed, fresh state, no frame cap,
+     * and logic stepped inline so every run renders the same frames. */
+    InputScript script = {0};
+    int scripted = (playPath != NULL);
+    if (scripted && !scriptLoad(&script, playPath)) return 1;
+    InputRecorder recorder = {0};
+    if (recordPath && !(recorder.f = fopen(recordPath, "w"))) {
+        fprintf(stderr, "%s: cannot write\n", recordPath);
+        return 1;
+    }
+
+    uint32_t seed = (uint32_t)time(NULL);
+    if (script.hasSeed) seed = script.seed;
+    if (seedArg >= 0)   seed = (uint32_t)seedArg;
+
+    /* Networked co-op: connect first, the host's seed is the match's */
+    static CoopLink link;
+    CoopLink *net = NULL;
+    int coopClasses[2] = {0, 0};
+    if (coopHost || coopJoin) {
+        int c = 0;
+        while (c < 3 && strcmp(coopClass, CLASS_KEY[c])) c++;
+        if (c == 3)   { fprintf(stderr, "--coop-class wants knight, magician or alchemist\n"); return 1; }
+        if (scripted) { fprintf(stderr, "--coop-host/--coop-join can't replay a --play script\n"); return 1; }
+        if (!coopOpen(&link, coopHost ? coopHost : coopJoin, coopHost != NULL, c, &seed, coopClasses)) return 1;
+        net = &link;
+        gSaveEnabled = 0;   /* a resumed half of a lockstep match has no partner */
+    }
+    seedRng(seed);
+    if (recorder.f) fprintf(recorder.f, "seed %u\n", seed);
+    if (scripted) gSaveEnabled = 0;
+
+    if (gEngine.path) {
+        enginePoll(&gEngine, NULL);   /* first poll only notes the file... */
+        enginePoll(&gEngine, NULL);   /* ...second one loads it */
+        if (!gEngine.handle) return 1;
+    }
+    if (gBalPatch.path) {   /* a patch may also turn up later; none now is fine */
+        balPoll(&gBalPatch, NULL);
+        balPoll(&gBalPatch, NULL);
+    }
+
+    SetConfigFlags(exportDir ? FLAG_WINDOW_HIDDEN : FLAG_WINDOW_RESIZABLE);
     InitWindow(SW, SH, "Trial by Combat");
-    SetTargetFPS(60);
+    SetWindowMinSize(SW/4, SH/4);
+    SetTargetFPS(scripted ? 0 : TARGET_FPS);
 
     /* Load custom font. Place font.ttf in the same folder as the executable.
      * Rename FONT_FILE at the top of this file to match your font filename.
      * If the file is missing, Raylib uses its default font automatically. */
     gFont = LoadFontEx(FONT_FILE, FONT_SIZE_LOAD, NULL, 0);
     if (gFont.baseSize == 0) gFont = GetFontDefault();
+    hudInitStatic(&gHudStatic);
 
     /* Load sprites: [player][class] */
     static const char *spriteFiles[2][3] = {
@@ -999,273 +5817,144 @@ int main(void) {
         for (int c=0;c<3;c++)
             gSprites[p][c] = LoadTexture(spriteFiles[p][c]);
 
-    GameState gs;
-    memset(&gs, 0, sizeof(gs));
-    gs.screen = SCREEN_MENU;
+    layoutRefresh(&gLayout);
+    RenderScaler scaler;
+    scalerInit(&scaler, renderScale, dynamicRes);
 
-    int hoverClass = 0;  /* for class/opponent select hover */
+    /* The opening match (fresh, resumed or networked) starts on what's live now */
+    BalVersion *firstBal = balPin(), *drawBal = NULL;
+    gBal = firstBal->bal;
+    GameState gs;
+    if (net) {
+        memset(&gs, 0, sizeof(gs));
+        initFighter(&gs.p1, "Champion 1", coopClasses[0]);
+        initFighter(&gs.p2, "Champion 2", coopClasses[1]);
+        initGauntlet(&gs);
+        coopStart(&gs, 2, net->seat);
+        gs.vsComputer = 5;   /* networked co-op: no rematch from the result screen */
+        gs.screen = SCREEN_GAUNTLET_BATTLE;
+    } else if (scripted || !loadMatch(&gs)) {
+        memset(&gs, 0, sizeof(gs));
+        gs.screen = SCREEN_MENU;
+    }
+    gs.bal = firstBal;
+    stateChanged(&gs);
+
+    /* SimThread carries three GameState copies - keep it off the stack */
+    static SimThread sim;
+    if (!scripted) simStart(&sim, &gs, net);
+    double lastMetricsDump = GetTime(), lastEnginePoll = GetTime();
+    FrameReport report = {0};
+    FrameExporter exporter;
+    int exportFrames = 0, lastScreen = -1;
+    uint64_t exportStart = nowNs();
+    if (exportDir && !exporterStart(&exporter, exportDir)) {
+        fprintf(stderr, "--export: out of memory\n");
+        CloseWindow();
+        return 1;
+    }
+    int status = 0;
 
     while (!WindowShouldClose()) {
+        uint64_t frameStart = nowNs();
 
         /* F11 toggles fullscreen on any screen */
         if (IsKeyPressed(KEY_F11)) ToggleFullscreen();
-
-        /* ===== UPDATE ===== */
-        switch (gs.screen) {
-
-            case SCREEN_MENU:
-                if (IsKeyPressed(KEY_ONE))   { gs.vsComputer=1; gs.screen=SCREEN_SELECT_CLASS_P1; hoverClass=0; }
-                if (IsKeyPressed(KEY_TWO))   { gs.vsComputer=0; gs.screen=SCREEN_SELECT_CLASS_P1; hoverClass=0; }
-                if (IsKeyPressed(KEY_THREE)) CloseWindow();
-
-                /* Secret: type GAUNTLET to unlock 3v1 mode */
-                {
-                    static const char *secret = "GAUNTLET";
-                    int key = GetKeyPressed();
-                    if (key >= 'A' && key <= 'Z') {
-                        if (gs.secretLen < 8) {
-                            gs.secretBuf[gs.secretLen++] = (char)key;
-                            gs.secretBuf[gs.secretLen]   = '\0';
-                        } else {
-                            /* shift buffer left */
-                            memmove(gs.secretBuf, gs.secretBuf+1, 7);
-                            gs.secretBuf[7] = (char)key;
-                            gs.secretBuf[8] = '\0';
-                            gs.secretLen = 8;
-                        }
-                        if (strcmp(gs.secretBuf, secret) == 0) {
-                            /* Unlock! Go to class select for gauntlet */
-                            gs.vsComputer = 2; /* 2 = gauntlet flag */
-                            gs.screen = SCREEN_SELECT_CLASS_P1;
-                            gs.secretLen = 0;
-                            gs.secretBuf[0] = '\0';
-                            hoverClass = 0;
-                        }
-                    }
-                }
-                break;
-
-            case SCREEN_SELECT_CLASS_P1: {
-                int c=-1;
-                if (IsKeyPressed(KEY_ONE))   c=0;
-                if (IsKeyPressed(KEY_TWO))   c=1;
-                if (IsKeyPressed(KEY_THREE)) c=2;
-                if (c>=0) {
-                    if (gs.vsComputer==2) {
-                        /* Gauntlet mode */
-                        initFighter(&gs.p1, "Champion", c);
-                        initGauntlet(&gs);
-                        gs.screen=SCREEN_GAUNTLET_BATTLE;
-                    } else {
-                        initFighter(&gs.p1, gs.vsComputer?"Player":"Player 1", c);
-                        gs.screen = gs.vsComputer ? SCREEN_SELECT_OPPONENT : SCREEN_SELECT_CLASS_P2;
-                    }
-                    hoverClass=0;
-                }
-                if (IsKeyPressed(KEY_UP))   hoverClass=(hoverClass+2)%3;
-                if (IsKeyPressed(KEY_DOWN)) hoverClass=(hoverClass+1)%3;
-                break;
-            }
-
-            case SCREEN_SELECT_CLASS_P2: {
-                int c=-1;
-                if (IsKeyPressed(KEY_ONE))   c=0;
-                if (IsKeyPressed(KEY_TWO))   c=1;
-                if (IsKeyPressed(KEY_THREE)) c=2;
-                if (c>=0) {
-                    initFighter(&gs.p2, "Player 2", c);
-                    gs.screen=SCREEN_BATTLE;
-                    gs.turn=1; gs.selectedMove=0; gs.p1chosen=0;
-                    logClear(&gs.log);
-                }
-                if (IsKeyPressed(KEY_UP))   hoverClass=(hoverClass+2)%3;
-                if (IsKeyPressed(KEY_DOWN)) hoverClass=(hoverClass+1)%3;
-                break;
-            }
-
-            case SCREEN_SELECT_OPPONENT: {
-                int chosen=-1;
-                if (IsKeyPressed(KEY_ONE))   chosen=0;
-                if (IsKeyPressed(KEY_TWO))   chosen=1;
-                if (IsKeyPressed(KEY_THREE)) chosen=2;
-                if (IsKeyPressed(KEY_FOUR))  chosen=rand()%3;
-                if (chosen>=0) {
-                    static const char *cn[3]={"Knight","Magician","Alchemist"};
-                    initFighter(&gs.p2, cn[chosen], chosen);
-                    gs.screen=SCREEN_BATTLE;
-                    gs.turn=1; gs.selectedMove=0; gs.p1chosen=0;
-                    logClear(&gs.log);
-                }
-                if (IsKeyPressed(KEY_UP))   hoverClass=(hoverClass+3)%4;
-                if (IsKeyPressed(KEY_DOWN)) hoverClass=(hoverClass+1)%4;
-                break;
-            }
-
-            case SCREEN_BATTLE: {
-                /* move selection with keyboard */
-                Fighter *cf = (!gs.vsComputer && gs.p1chosen) ? &gs.p2 : &gs.p1;
-                Move *moves = getMoves(cf->classId);
-
-                if (IsKeyPressed(KEY_UP)||IsKeyPressed(KEY_W))
-                    gs.selectedMove=(gs.selectedMove+4)%5;
-                if (IsKeyPressed(KEY_DOWN)||IsKeyPressed(KEY_S))
-                    gs.selectedMove=(gs.selectedMove+1)%5;
-
-                if (IsKeyPressed(KEY_ENTER)||IsKeyPressed(KEY_SPACE)) {
-                    int idx=gs.selectedMove;
-                    if (cf->charge < moves[idx].cost) break; /* locked, ignore */
-
-                    if (gs.vsComputer) {
-                        gs.moveP1=idx;
-                        gs.moveP2=chooseMoveAI(&gs.p2,&gs.p1);
-                        logClear(&gs.log);
-                        resolveTurn(&gs.p1,&gs.p2,gs.moveP1,gs.moveP2,&gs.log);
-                        gs.screen=SCREEN_RESOLVE;
-                    } else {
-                        if (!gs.p1chosen) {
-                            gs.moveP1=idx;
-                            gs.p1chosen=1;
-                            gs.selectedMove=0;
-                        } else {
-                            gs.moveP2=idx;
-                            gs.p1chosen=0;
-                            logClear(&gs.log);
-                            resolveTurn(&gs.p1,&gs.p2,gs.moveP1,gs.moveP2,&gs.log);
-                            gs.screen=SCREEN_RESOLVE;
-                        }
-                    }
-                }
-                break;
-            }
-
-            case SCREEN_RESOLVE:
-                if (IsKeyPressed(KEY_ENTER)||IsKeyPressed(KEY_SPACE)) {
-                    int d1=(gs.p1.hp<=0), d2=(gs.p2.hp<=0);
-                    if (d1||d2) {
-                        if (d1&&d2) strncpy(gs.resultMsg,"DRAW! Both fell!",127);
-                        else if(d1) snprintf(gs.resultMsg,128,"%s WINS!",gs.p2.name);
-                        else        snprintf(gs.resultMsg,128,"%s WINS!",gs.p1.name);
-                        gs.screen=SCREEN_RESULT;
-                    } else if (gs.turn >= MAX_TURNS) {
-                        if      (gs.p1.hp>gs.p2.hp) snprintf(gs.resultMsg,128,"%s WINS by HP!",gs.p1.name);
-                        else if (gs.p2.hp>gs.p1.hp) snprintf(gs.resultMsg,128,"%s WINS by HP!",gs.p2.name);
-                        else    strncpy(gs.resultMsg,"DRAW! Equal HP!",127);
-                        gs.screen=SCREEN_RESULT;
-                    } else {
-                        gs.turn++;
-                        gs.selectedMove=0;
-                        gs.p1chosen=0;
-                        logClear(&gs.log);   /* clear log so battle screen is clean */
-                        gs.screen=SCREEN_BATTLE;
-                    }
-                }
-                break;
-
-            case SCREEN_GAUNTLET_BATTLE: {
-                Fighter *p = &gs.p1;
-                Move *moves = getMoves(p->classId);
-
-                if (IsKeyPressed(KEY_UP)||IsKeyPressed(KEY_W))
-                    gs.selectedMove=(gs.selectedMove+4)%5;
-                if (IsKeyPressed(KEY_DOWN)||IsKeyPressed(KEY_S))
-                    gs.selectedMove=(gs.selectedMove+1)%5;
-
-                /* LEFT/RIGHT to cycle living targets */
-                if (IsKeyPressed(KEY_LEFT)||IsKeyPressed(KEY_A)) {
-                    int t=gs.selectedTarget;
-                    do { t=(t+2)%3; } while(gs.enemies[t].hp<=0 && t!=gs.selectedTarget);
-                    gs.selectedTarget=t;
-                }
-                if (IsKeyPressed(KEY_RIGHT)||IsKeyPressed(KEY_D)) {
-                    int t=gs.selectedTarget;
-                    do { t=(t+1)%3; } while(gs.enemies[t].hp<=0 && t!=gs.selectedTarget);
-                    gs.selectedTarget=t;
-                }
-
-                if (IsKeyPressed(KEY_ENTER)||IsKeyPressed(KEY_SPACE)) {
-                    int idx=gs.selectedMove;
-                    if (p->charge < moves[idx].cost) break;
-                    gs.gauntletMove=idx;
-                    logClear(&gs.log);
-                    resolveGauntletTurn(&gs);
-                    gs.screen=SCREEN_GAUNTLET_RESOLVE;
-                }
-                break;
+        if (layoutRefresh(&gLayout)) scalerResize(&scaler, scaler.scale);
+
+        /* ===== UPDATE (on the sim thread, inline when scripted) ===== */
+        InputFrame in;
+        if (scripted) { if (!scriptNext(&script, &in)) break; }
+        else          pollInput(&in);
+        recordFrame(&recorder, &in);
+        if (net) coopRecv(net, &in);
+
+        GameState *view;
+        if (scripted) {
+            enginePoll(&gEngine, &gs);
+            balPoll(&gBalPatch, &gs);
+            updateGame(&gs, &in);
+            view = &gs;
+        } else {
+            if (!inputEmpty(&in)) simSend(&sim, &in);
+            else if ((gEngine.path || gBalPatch.path) && GetTime() - lastEnginePoll >= 0.5) {
+                simRing(&sim);   /* sim thread polls the engine and balance files when woken */
+                lastEnginePoll = GetTime();
             }
+            view = tbLatest(&sim.view);
+        }
+        if (view->postChoice == 3) break;   /* Exit chosen */
 
-            case SCREEN_GAUNTLET_RESOLVE:
-                if (IsKeyPressed(KEY_ENTER)||IsKeyPressed(KEY_SPACE)) {
-                    int playerDead=(gs.p1.hp<=0);
-                    int allDead=allEnemiesDead(&gs);
-
-                    if (playerDead) {
-                        snprintf(gs.resultMsg,128,"You fell... the Gauntlet wins.");
-                        gs.screen=SCREEN_RESULT;
-                    } else if (allDead) {
-                        snprintf(gs.resultMsg,128,"GAUNTLET CLEARED! Champion stands alone!");
-                        gs.screen=SCREEN_RESULT;
-                    } else if (gs.turn >= MAX_TURNS) {
-                        snprintf(gs.resultMsg,128,"Time expired. The Gauntlet is unfinished.");
-                        gs.screen=SCREEN_RESULT;
-                    } else {
-                        gs.turn++;
-                        gs.selectedMove=0;
-                        int f=firstAliveEnemy(&gs);
-                        if(f>=0 && gs.enemies[gs.selectedTarget].hp<=0) gs.selectedTarget=f;
-                        logClear(&gs.log);
-                        gs.screen=SCREEN_GAUNTLET_BATTLE;
-                    }
-                }
-                break;
-
-            case SCREEN_RESULT:
-                if (IsKeyPressed(KEY_ONE)) {
-                    char name1[32]; int c1=gs.p1.classId;
-                    strncpy(name1, gs.p1.name, 31); name1[31]='\0';
-                    int wasGauntlet = gs.gauntletMode;
-                    if (wasGauntlet) {
-                        initFighter(&gs.p1, name1, c1);
-                        initGauntlet(&gs);
-                        gs.screen=SCREEN_GAUNTLET_BATTLE;
-                    } else {
-                        char name2[32]; int c2=gs.p2.classId;
-                        strncpy(name2, gs.p2.name, 31); name2[31]='\0';
-                        initFighter(&gs.p1, name1, c1);
-                        initFighter(&gs.p2, name2, c2);
-                        gs.turn=1; gs.selectedMove=0; gs.p1chosen=0;
-                        logClear(&gs.log);
-                        gs.screen=SCREEN_BATTLE;
-                    }
-                }
-                if (IsKeyPressed(KEY_TWO)) { memset(&gs,0,sizeof(gs)); gs.screen=SCREEN_MENU; }
-                if (IsKeyPressed(KEY_THREE)) CloseWindow();
-                break;
+        if (GetTime() - lastMetricsDump >= METRICS_DUMP_SECS) {
+            metricsDump(sizeof(GameState));
+            lastMetricsDump = GetTime();
         }
 
         /* ===== DRAW ===== */
-        BeginDrawing();
-        ClearBackground(BLACK);
+        if (balRepin(&drawBal)) {   /* the menus quote the live balance */
+            gBal = drawBal->bal;
+            hudInitStatic(&gHudStatic);
+        }
+        hudRefresh(&gHud, view);
+        if (view->screen == SCREEN_DASHBOARD && lastScreen != SCREEN_DASHBOARD) dashReload();
+        lastScreen = view->screen;
+        scalerBegin(&scaler);
 
-        switch (gs.screen) {
+        switch (view->screen) {
             case SCREEN_MENU:            drawMenuScreen();                      break;
-            case SCREEN_SELECT_CLASS_P1: drawClassSelectScreen("Choose Class", hoverClass); break;
-            case SCREEN_SELECT_CLASS_P2: drawClassSelectScreen("Player 2 - Choose Class", hoverClass); break;
-            case SCREEN_SELECT_OPPONENT: drawOpponentSelectScreen(hoverClass);  break;
-            case SCREEN_BATTLE:          drawBattleScreen(&gs);                 break;
-            case SCREEN_RESOLVE:         drawResolveScreen(&gs);                break;
-            case SCREEN_RESULT:          drawResultScreen(&gs);                 break;
-            case SCREEN_GAUNTLET_BATTLE:  drawGauntletBattle(&gs);             break;
-            case SCREEN_GAUNTLET_RESOLVE: drawGauntletResolve(&gs);            break;
+            case SCREEN_SELECT_CLASS_P1: drawClassSelectScreen("Choose Class", view->hoverClass); break;
+            case SCREEN_SELECT_CLASS_P2: drawClassSelectScreen("Player 2 - Choose Class", view->hoverClass); break;
+            case SCREEN_SELECT_OPPONENT: drawOpponentSelectScreen(view->hoverClass);  break;
+            case SCREEN_BATTLE:          drawBattleScreen(view);                break;
+            case SCREEN_RESOLVE:         drawResolveScreen(view);               break;
+            case SCREEN_RESULT:          drawResultScreen(view);                break;
+            case SCREEN_GAUNTLET_BATTLE:  drawGauntletBattle(view);            break;
+            case SCREEN_GAUNTLET_RESOLVE: drawGauntletResolve(view);           break;
+            case SCREEN_DASHBOARD:        drawDashboard(view->hoverClass);     break;
         }
 
-        EndDrawing();
+        uint64_t submitStart = nowNs();
+        scalerEnd(&scaler);
+        scalerUpdate(&scaler, GetFrameTime());
+        if (exportDir) exporterSubmit(&exporter, LoadImageFromTexture(scaler.target.texture), exportFrames++);
+
+        if (reportPath) {
+            uint64_t end = nowNs();
+            reportAdd(&report, (FrameSample){ (submitStart-frameStart)*1e-6f, (end-submitStart)*1e-6f,
+                                              (end-frameStart)*1e-6f, (uint8_t)view->screen });
+        }
+    }
+
+    if (reportPath) reportWrite(&report, reportPath);
+    if (exportDir) {
+        int failed = exporterFinish(&exporter);
+        double secs = (nowNs() - exportStart) * 1e-9;
+        printf("exported %d frames to %s in %.1fs (%.1fx real time, %d encoders)%s\n",
+               exportFrames, exportDir, secs, exportFrames / (double)TARGET_FPS / (secs > 0 ? secs : 1e-9),
+               exporter.threadCount, failed ? " - some frames failed to write" : "");
+        if (failed) status = 1;
+    }
+    if (recorder.f) {
+        if (recorder.idle) fprintf(recorder.f, "wait %d\n", recorder.idle);
+        fclose(recorder.f);
     }
 
     for (int p=0;p<2;p++)
         for (int c=0;c<3;c++)
             UnloadTexture(gSprites[p][c]);
+    if (!scripted) simStop(&sim);
+    balUnpin(scripted ? gs.bal : sim.live.bal);   /* the match's; main's gs went stale once the sim took it */
+    balUnpin(drawBal);
+    if (net) net->close(net);
+#ifndef _WIN32
+    if (gEngine.handle) dlclose(gEngine.handle);
+#endif
+    UnloadRenderTexture(scaler.target);
     UnloadFont(gFont);
+    metricsDump(sizeof(GameState));
 
     CloseWindow();
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
+
+#endif /* TBC_ENGINE_SO */